@@ -9,7 +9,7 @@ QT       += core gui
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 greaterThan(QT_MAJOR_VERSION, 4) {
-    QT       += widgets serialport
+    QT       += widgets serialport concurrent
 } else {
     include($$QTSERIALPORT_PROJECT_ROOT/src/serialport/qt4support/serialport.prf)
 }
@@ -54,10 +54,22 @@ SOURCES += main.cpp\
     avruploaddata.cpp \
     lightbuddypatternuploader.cpp \
     serialcommandqueue.cpp \
+    serialcommand.cpp \
     lightbuddyprotocol.cpp \
     letterboxscrollarea.cpp \
     undocommand.cpp \
-    colorchooser.cpp
+    colorchooser.cpp \
+    encodingselector.cpp \
+    paletteanalysis.cpp \
+    framestore.cpp \
+    patternheaderwriter.cpp \
+    palettequantizer.cpp \
+    patterndecoder.cpp \
+    framecache.cpp \
+    patternsizeestimator.cpp \
+    decodecostmodel.cpp \
+    flashimage.cpp \
+    flashrecord.cpp
 
 HEADERS  += mainwindow.h \
     blinkytape.h \
@@ -77,10 +89,22 @@ HEADERS  += mainwindow.h \
     avruploaddata.h \
     lightbuddypatternuploader.h \
     serialcommandqueue.h \
+    serialcommand.h \
     lightbuddyprotocol.h \
     letterboxscrollarea.h \
     undocommand.h \
-    colorchooser.h
+    colorchooser.h \
+    encodingselector.h \
+    paletteanalysis.h \
+    framestore.h \
+    patternheaderwriter.h \
+    palettequantizer.h \
+    patterndecoder.h \
+    framecache.h \
+    patternsizeestimator.h \
+    decodecostmodel.h \
+    flashimage.h \
+    flashrecord.h
 
 FORMS    += mainwindow.ui \
     systeminformation.ui \
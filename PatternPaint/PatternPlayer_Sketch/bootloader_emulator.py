@@ -0,0 +1,419 @@
+#!/usr/bin/python
+""" Emulates a BlinkyTape on a pseudo-terminal, for testing and benchmarking
+uploads without hardware.
+
+The emulator starts out running a 'sketch', which ignores anything sent to it.
+Setting the port to 1200 baud resets it into an AVR109 (Caterina) bootloader,
+the same way BlinkyTape::reset() does with a real tape. The bootloader keeps a
+32 KB flash array, and answers the commands that AvrProgrammer sends, plus the
+ones avrdude's avr109 programmer needs. The 'E' command, or the bootloader
+timeout, starts the sketch again.
+
+Timing and faults can be set from the command line, so that an upload can be
+measured against a slow or unreliable device. Statistics for each bootloader
+session are printed when it ends.
+"""
+from __future__ import print_function
+
+import argparse
+import errno
+import os
+import pty
+import random
+import select
+import sys
+import termios
+import time
+import tty
+
+FLASH_SIZE      = 0x8000  # ATmega32U4
+APPLICATION_END = 0x7000  # Caterina lives above this
+PAGE_SIZE       = 0x80
+SIGNATURE       = bytearray([0x87, 0x95, 0x1E])  # Sent low byte first, like Caterina
+SOFTWARE_ID     = b'CATERIN'
+SOFTWARE_VER    = b'10'
+EXIT_DELAY      = 0.05    # Time between answering 'E' and starting the sketch, in seconds
+
+# Bytes that follow each command character, before any data
+COMMAND_ARGUMENTS = {
+  ord('A'): 2,  # Address (word, high, low)
+  ord('B'): 3,  # Block write: size (high, low), memory type, then data
+  ord('g'): 3,  # Block read: size (high, low), memory type
+  ord('T'): 1,  # Select device type
+  ord('x'): 1,  # Set LED
+  ord('y'): 1,  # Clear LED
+}
+
+
+class Port:
+  """ One end of a pseudo-terminal, standing in for a USB serial device """
+
+  def __init__(self, link):
+    self.master, self.slave = pty.openpty()
+    self.name = os.ttyname(self.slave)
+    self.link = link
+
+    # The emulator keeps the slave end open, so that its settings (the baud
+    # rate in particular) stay readable when the application closes the port.
+    tty.setraw(self.slave)
+    attributes = termios.tcgetattr(self.slave)
+    attributes[4] = attributes[5] = termios.B115200
+    termios.tcsetattr(self.slave, termios.TCSANOW, attributes)
+
+    if link:
+      temporary = link + '.new'
+      if os.path.lexists(temporary):
+        os.remove(temporary)
+      os.symlink(self.name, temporary)
+      os.rename(temporary, link)
+
+  def close(self):
+    os.close(self.master)
+    os.close(self.slave)
+
+  def baudRate(self):
+    return termios.tcgetattr(self.slave)[5]
+
+  def read(self):
+    try:
+      return bytearray(os.read(self.master, 4096))
+    except OSError as e:
+      if e.errno == errno.EIO:
+        return bytearray()
+      raise
+
+  def write(self, data):
+    os.write(self.master, bytes(data))
+
+
+class Session:
+  """ Statistics for one bootloader session """
+
+  def __init__(self):
+    self.start = None
+    self.end = None
+    self.commands = {}
+    self.bytesIn = 0
+    self.bytesOut = 0
+    self.bytesWritten = 0
+    self.bytesRead = 0
+    self.faults = 0
+
+  def command(self, name):
+    now = time.time()
+    if self.start is None:
+      self.start = now
+    self.end = now
+    self.commands[name] = self.commands.get(name, 0) + 1
+
+  def report(self):
+    if self.start is None:
+      print('Session ended without any commands')
+      return
+
+    elapsed = self.end - self.start
+    print('Session: %.3fs, %i commands, %i bytes in, %i bytes out'
+          % (elapsed, sum(self.commands.values()), self.bytesIn, self.bytesOut))
+    print('  flash written: %i bytes, read: %i bytes, faults injected: %i'
+          % (self.bytesWritten, self.bytesRead, self.faults))
+    if elapsed > 0 and self.bytesWritten > 0:
+      print('  write throughput: %.1f kB/s' % (self.bytesWritten / elapsed / 1024))
+    print('  commands: ' + ', '.join('%s=%i' % (name, count)
+                                      for name, count in sorted(self.commands.items())))
+    sys.stdout.flush()
+
+
+class Emulator:
+  def __init__(self, args):
+    self.args = args
+    self.random = random.Random(args.seed)
+    self.latency = {}
+    for setting in args.latency:
+      command, ms = setting.split('=')
+      self.latency[command] = float(ms) / 1000
+
+    self.flash = bytearray([0xFF] * FLASH_SIZE)
+    if args.flash_in:
+      with open(args.flash_in, 'rb') as fp:
+        data = bytearray(fp.read())[:FLASH_SIZE]
+      self.flash[:len(data)] = data
+
+    self.port = Port(args.link)
+    self.inBootloader = False
+    self.buffer = bytearray()
+    self.incoming = []   # (time, data) for data from the host that hasn't arrived yet
+    self.outgoing = []   # (time, data) for each packet to send, in time order
+    self.busyUntil = 0   # Time that the last command's response is sent
+    self.lastCommand = 0
+    self.address = 0     # Current address, in words
+    self.session = None
+    self.commandCount = 0
+    self.exitPending = False
+    self.exitTime = 0
+
+    print('Emulated BlinkyTape on %s%s'
+          % (self.port.name, ' (linked from %s)' % args.link if args.link else ''))
+    sys.stdout.flush()
+
+    if args.start_in_bootloader:
+      self.startBootloader()
+
+  def reenumerate(self):
+    """ Replace the port with a new one, like a device that disconnects and
+    shows up again on the USB bus """
+    if not self.args.reenumerate:
+      return
+
+    self.port.close()
+    self.port = Port(self.args.link)
+    print('Re-enumerated as %s' % self.port.name)
+    sys.stdout.flush()
+
+  def startBootloader(self):
+    print('Starting bootloader')
+    self.inBootloader = True
+    self.buffer = bytearray()
+    self.incoming = []
+    self.outgoing = []
+    self.busyUntil = 0
+    self.lastCommand = time.time()
+    self.session = Session()
+    self.commandCount = 0
+    self.reenumerate()
+
+  def startSketch(self):
+    print('Starting sketch')
+    if self.session:
+      self.session.report()
+      self.session = None
+    self.inBootloader = False
+    self.buffer = bytearray()
+    self.incoming = []
+    self.reenumerate()
+
+    # The sketch comes up at the normal baud rate
+    attributes = termios.tcgetattr(self.port.slave)
+    attributes[4] = attributes[5] = termios.B115200
+    termios.tcsetattr(self.port.slave, termios.TCSANOW, attributes)
+
+    if self.args.flash_out:
+      with open(self.args.flash_out, 'wb') as fp:
+        fp.write(bytes(self.flash))
+
+  def respond(self, name, response, delay=0):
+    """ Schedule a response, after the command's latency, split into USB packets """
+    now = time.time()
+    start = max(now, self.busyUntil) + self.latency.get(name, self.args.default_latency / 1000.0) + delay
+
+    if self.args.drop_rate and self.random.random() < self.args.drop_rate:
+      print('Fault: dropping the response to %s' % name)
+      self.session.faults += 1
+      self.busyUntil = start
+      return
+
+    response = bytearray(response)
+    if response and self.args.corrupt_rate and self.random.random() < self.args.corrupt_rate:
+      index = self.random.randrange(len(response))
+      response[index] ^= 0x01 << self.random.randrange(8)
+      print('Fault: corrupting the response to %s' % name)
+      self.session.faults += 1
+
+    packetTime = start
+    for offset in range(0, max(len(response), 1), self.args.packet_size):
+      self.outgoing.append((packetTime, response[offset:offset + self.args.packet_size]))
+      packetTime += self.args.packet_interval / 1000.0
+
+    self.busyUntil = packetTime
+    self.session.bytesOut += len(response)
+
+  def writeFlash(self, data):
+    """ Write a block at the current address. Like Caterina, the pages that the
+    block touches are erased first, so the rest of a partly written page is lost. """
+    start = self.address * 2
+    if start + len(data) > APPLICATION_END:
+      print('Write to 0x%04X-0x%04X would overwrite the bootloader, ignoring'
+            % (start, start + len(data)))
+      return 0
+
+    pages = 0
+    for page in range(start - start % PAGE_SIZE, start + len(data), PAGE_SIZE):
+      self.flash[page:page + PAGE_SIZE] = bytearray([0xFF] * PAGE_SIZE)
+      pages += 1
+    self.flash[start:start + len(data)] = data
+
+    if self.args.write_fault_rate and self.random.random() < self.args.write_fault_rate:
+      index = start + self.random.randrange(len(data))
+      self.flash[index] ^= 0x01 << self.random.randrange(8)
+      print('Fault: corrupting flash at 0x%04X' % index)
+      self.session.faults += 1
+
+    self.address += len(data) // 2
+    self.session.bytesWritten += len(data)
+    return pages
+
+  def parseCommand(self):
+    """ Handle the command at the front of the buffer
+    @return False if the command isn't complete yet """
+    command = self.buffer[0]
+    argumentCount = COMMAND_ARGUMENTS.get(command, 0)
+    if len(self.buffer) < 1 + argumentCount:
+      return False
+
+    arguments = self.buffer[1:1 + argumentCount]
+    length = 1 + argumentCount
+    if command == ord('B'):
+      size = (arguments[0] << 8) + arguments[1]
+      length += size
+      if len(self.buffer) < length:
+        return False
+    data = self.buffer[1 + argumentCount:length]
+    del self.buffer[:length]
+
+    name = chr(command)
+    self.session.command(name)
+    self.session.bytesIn += length
+    self.lastCommand = time.time()
+    self.commandCount += 1
+
+    if self.args.hang_after and self.commandCount > self.args.hang_after:
+      if self.commandCount == self.args.hang_after + 1:
+        print('Fault: no longer responding')
+        self.session.faults += 1
+      return True
+
+    if name == 's':
+      self.respond(name, SIGNATURE)
+    elif name == 'b':
+      if self.args.block_size:
+        self.respond(name, bytearray([ord('Y'), self.args.block_size >> 8, self.args.block_size & 0xFF]))
+      else:
+        self.respond(name, b'?')
+    elif name == 'A':
+      self.address = (arguments[0] << 8) + arguments[1]
+      self.respond(name, b'\r')
+    elif name == 'B':
+      if arguments[2] != ord('F') or (self.args.block_size and size > self.args.block_size):
+        self.respond(name, b'?')
+      else:
+        pages = self.writeFlash(data)
+        self.respond(name, b'\r', pages * self.args.page_write_time / 1000.0)
+    elif name == 'g':
+      size = (arguments[0] << 8) + arguments[1]
+      if arguments[2] != ord('F'):
+        self.respond(name, b'?')
+      else:
+        start = self.address * 2
+        self.address += size // 2
+        self.session.bytesRead += size
+        self.respond(name, self.flash[start:start + size])
+    elif name == 'e':
+      self.flash[:APPLICATION_END] = bytearray([0xFF] * APPLICATION_END)
+      self.respond(name, b'\r', (APPLICATION_END // PAGE_SIZE) * self.args.page_write_time / 1000.0)
+    elif name == 'E':
+      self.respond(name, b'\r')
+      self.exitPending = True
+      self.exitTime = self.busyUntil + EXIT_DELAY
+    elif name == 'S':
+      self.respond(name, SOFTWARE_ID)
+    elif name == 'V':
+      self.respond(name, SOFTWARE_VER)
+    elif name == 'p':
+      self.respond(name, b'S')
+    elif name == 'a':
+      self.respond(name, b'Y')
+    elif name == 't':
+      self.respond(name, bytearray([0x44, 0x00]))
+    elif name in 'TPLxy':
+      self.respond(name, b'\r')
+    else:
+      self.respond(name, b'?')
+
+    return True
+
+  def run(self):
+    while True:
+      now = time.time()
+
+      # Send any responses that are due
+      while self.outgoing and self.outgoing[0][0] <= now:
+        self.port.write(self.outgoing.pop(0)[1])
+
+      if self.inBootloader and self.exitPending and not self.outgoing and now >= self.exitTime:
+        self.exitPending = False
+        self.startSketch()
+        continue
+
+      timeout = 0.01
+      if self.outgoing:
+        timeout = max(0, min(timeout, self.outgoing[0][0] - now))
+      if self.incoming:
+        timeout = max(0, min(timeout, self.incoming[0][0] - now))
+
+      readable, _, _ = select.select([self.port.master], [], [], timeout)
+      data = bytearray()
+      if readable:
+        data = self.port.read()
+
+      if not self.inBootloader:
+        # The sketch ignores pattern data, but resets into the bootloader when
+        # the port is set to 1200 baud.
+        if self.port.baudRate() == termios.B1200:
+          time.sleep(self.args.reset_delay / 1000.0)
+          self.startBootloader()
+        continue
+
+      # Data from the host reaches the bootloader after the turnaround time
+      if data:
+        self.incoming.append((now + self.args.turnaround / 1000.0, data))
+      while self.incoming and self.incoming[0][0] <= time.time():
+        self.buffer += self.incoming.pop(0)[1]
+
+      while self.buffer and not self.exitPending and self.parseCommand():
+        pass
+
+      if (self.args.bootloader_timeout and not self.outgoing
+          and time.time() - self.lastCommand > self.args.bootloader_timeout):
+        print('Bootloader timed out')
+        self.startSketch()
+
+
+parser = argparse.ArgumentParser(description='Emulate a BlinkyTape and its AVR109 bootloader on a pseudo-terminal')
+parser.add_argument('--link', help='create a symlink to the port at this path')
+parser.add_argument('--reenumerate', action='store_true',
+                    help='switch to a new port when resetting into or out of the bootloader, like a real device')
+parser.add_argument('--start-in-bootloader', action='store_true', help='skip the 1200 baud reset')
+parser.add_argument('--reset-delay', type=float, default=500,
+                    help='time between the 1200 baud reset and the bootloader starting, in ms (default 500)')
+parser.add_argument('--bootloader-timeout', type=float, default=8,
+                    help='seconds without a command before the bootloader starts the sketch; 0 to disable (default 8)')
+parser.add_argument('--block-size', type=int, default=PAGE_SIZE,
+                    help="buffer size reported by the 'b' command; 0 to report no block mode (default 128)")
+parser.add_argument('--latency', action='append', default=[], metavar='COMMAND=MS',
+                    help="delay before responding to a command, eg. --latency B=2 (repeatable)")
+parser.add_argument('--default-latency', type=float, default=0,
+                    help='delay before responding to other commands, in ms (default 0)')
+parser.add_argument('--turnaround', type=float, default=0,
+                    help='time for data from the host to reach the bootloader, in ms (1 for a full speed USB frame)')
+parser.add_argument('--page-write-time', type=float, default=0,
+                    help='extra delay for each page erased and written, in ms (about 4.5 on an ATmega32U4)')
+parser.add_argument('--packet-size', type=int, default=64,
+                    help='responses are sent in packets of this size, in bytes (default 64)')
+parser.add_argument('--packet-interval', type=float, default=0,
+                    help='time between packets, in ms (1 for a full speed USB frame)')
+parser.add_argument('--drop-rate', type=float, default=0, help='probability of not responding to a command')
+parser.add_argument('--corrupt-rate', type=float, default=0, help='probability of flipping a bit in a response')
+parser.add_argument('--write-fault-rate', type=float, default=0,
+                    help='probability of flipping a bit in the flash when a block is written')
+parser.add_argument('--hang-after', type=int, default=0,
+                    help='stop responding after this many commands in a session')
+parser.add_argument('--seed', type=int, help='random seed for fault injection')
+parser.add_argument('--flash-in', help='file to load the initial flash contents from')
+parser.add_argument('--flash-out', help='file to save the flash contents to, when the bootloader exits')
+args = parser.parse_args()
+
+emulator = Emulator(args)
+try:
+  emulator.run()
+except KeyboardInterrupt:
+  if emulator.session:
+    emulator.session.report()
@@ -1,5 +1,9 @@
 #!/usr/bin/python
 import argparse
+import sys
+
+# The sketch has to end before the pattern table page (FLASH_MEMORY_PATTERN_TABLE_ADDRESS)
+PATTERN_TABLE_ADDRESS = 0x7000 - 0x80
 
 def ParseLine(line):
   """ Parse a line of an Intel HEX file into its component parts """
@@ -41,6 +45,11 @@ def HexToHeader(fileName, animationName):
         print "type not understood: ", type
         exit(1)
 
+  if len(headerData)/2 > PATTERN_TABLE_ADDRESS:
+    print >> sys.stderr, "Sketch is %i bytes, but it has to fit below the pattern table at 0x%04X" \
+        %(len(headerData)/2, PATTERN_TABLE_ADDRESS)
+    exit(1)
+
   print "#ifndef %s_SKETCH_H"%(animationName)
   print "#define %s_SKETCH_H"%(animationName)
   print ""
@@ -0,0 +1,318 @@
+#!/usr/bin/python
+""" Times the upload command sequences that AvrPatternUploader sends, against
+bootloader_emulator.py, so that changes to the upload path can be compared
+without a tape.
+
+Each scenario starts a fresh emulator in its bootloader, optionally loaded
+with the flash contents of an earlier upload, then replays the commands that
+the uploader would send for it: the signature and block size checks, any read
+back, the page writes, any verification reads, and the reset. Up to --window
+commands are sent before waiting for their responses, like SerialCommandQueue.
+
+Each scenario is also checked: the flash that the emulator ends up with must
+match the image, reading back must skip the pages that are already on the
+device, and verifying must catch pages that were written wrongly, rewrite
+them, and give up if they still don't match. The exit status is 1 if any
+check fails.
+
+This replays the command stream rather than running PatternPaint itself; to
+run the real uploader against the emulator, set PATTERNPAINT_TAPE_PORT.
+"""
+from __future__ import print_function
+
+import argparse
+import os
+import select
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+FLASH_SIZE          = 0x8000
+PAGE_SIZE           = 0x80
+PATTERN_TABLE       = 0x7000 - PAGE_SIZE
+READ_BACK_BLOCK     = 1024  # READ_BACK_BLOCK_SIZE in avrpatternuploader.cpp
+VERIFY_RETRIES      = 2     # VERIFY_RETRY_COUNT in avrpatternuploader.cpp
+
+
+def pages(start, length):
+  return list(range(start - start % PAGE_SIZE, start + length, PAGE_SIZE))
+
+
+def runs(pageList):
+  """ Merge pages into (address, length) runs, like FlashImage::mergePages() """
+  merged = []
+  for page in sorted(pageList):
+    if merged and merged[-1][0] + merged[-1][1] == page:
+      merged[-1] = (merged[-1][0], merged[-1][1] + PAGE_SIZE)
+    else:
+      merged.append((page, PAGE_SIZE))
+  return merged
+
+
+class Client:
+  """ Sends commands with a window of them in flight, like SerialCommandQueue """
+
+  def __init__(self, path, window):
+    self.fd = os.open(os.path.realpath(path), os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(self.fd)
+    self.window = window
+    self.pending = []   # (response length, keep the response) for each command in flight
+    self.received = bytearray()
+    self.responses = []  # Responses to the commands that asked to keep them
+
+  def command(self, data, responseLength, keep=False):
+    while len(self.pending) >= self.window:
+      self.receive()
+    os.write(self.fd, bytes(bytearray(data)))
+    self.pending.append((responseLength, keep))
+
+  def receive(self):
+    if self.pending and len(self.received) >= self.pending[0][0]:
+      length, keep = self.pending.pop(0)
+      if keep:
+        self.responses.append(self.received[:length])
+      del self.received[:length]
+      return
+
+    readable, _, _ = select.select([self.fd], [], [], 2)
+    if not readable:
+      raise RuntimeError('command timed out')
+    self.received += bytearray(os.read(self.fd, 4096))
+
+  def finish(self):
+    while self.pending:
+      self.receive()
+
+  def setAddress(self, address):
+    self.command([ord('A'), (address >> 9) & 0xFF, (address >> 1) & 0xFF], 1)
+
+  def write(self, address, length, image, blockSize):
+    self.setAddress(address)
+    for offset in range(0, length, blockSize):
+      chunk = image[address + offset:address + min(length, offset + blockSize)]
+      self.command(bytearray([ord('B'), len(chunk) >> 8, len(chunk) & 0xFF, ord('F')]) + chunk, 1)
+
+  def read(self, address, length):
+    for offset in range(0, length, READ_BACK_BLOCK):
+      size = min(READ_BACK_BLOCK, length - offset)
+      self.setAddress(address + offset)
+      self.command([ord('g'), size >> 8, size & 0xFF, ord('F')], size, True)
+
+
+def readPages(client, pageList):
+  """ Read pages back from the flash
+  @return Contents of each page, by page address """
+  blocks = []
+  for address, length in runs(pageList):
+    client.read(address, length)
+    for blockOffset in range(0, length, READ_BACK_BLOCK):
+      blocks.append((address + blockOffset, min(READ_BACK_BLOCK, length - blockOffset)))
+  client.finish()
+
+  contents = {}
+  for (address, length), data in zip(blocks, client.responses):
+    for page in range(address, address + length, PAGE_SIZE):
+      contents[page] = data[page - address:page - address + PAGE_SIZE]
+  client.responses = []
+  return contents
+
+
+def mismatchedPages(client, image, pageList):
+  """ Read pages back, and find the ones that don't match the image """
+  contents = readPages(client, pageList)
+  return [page for page in sorted(contents) if contents[page] != image[page:page + PAGE_SIZE]]
+
+
+class Result:
+  """ What a scenario did, for checking """
+
+  def __init__(self):
+    self.written = []         # Pages written, including rewrites after a failed verify
+    self.verifyRetries = 0    # Number of times pages were rewritten after a failed verify
+    self.verifyFailures = []  # Pages that still didn't match after the last retry
+    self.flash = None         # Flash contents once the bootloader exited
+
+
+def buildImage(sketchLength, patternLength, seed):
+  """ Sketch at 0, pattern data after it, and the pattern table page """
+  image = bytearray([0xFF] * FLASH_SIZE)
+  for index in range(sketchLength):
+    image[index] = (index * 7 + 3) & 0xFF
+  patternStart = sketchLength + (-sketchLength % PAGE_SIZE)
+  for index in range(patternLength):
+    image[patternStart + index] = (index * 13 + seed) & 0xFF
+  image[PATTERN_TABLE:PATTERN_TABLE + 16] = bytearray([seed & 0xFF] * 16)
+  dirty = pages(0, sketchLength) + pages(patternStart, patternLength) + [PATTERN_TABLE]
+  return image, dirty
+
+
+def runScenario(args, name, image, dirty, toWrite, flashIn, readBack, verify, window, blockSize, faults=[]):
+  directory = tempfile.mkdtemp()
+  link = os.path.join(directory, 'tape')
+  flashPath = os.path.join(directory, 'flash.bin')
+  flashOutPath = os.path.join(directory, 'flash-out.bin')
+  with open(flashPath, 'wb') as fp:
+    fp.write(bytes(flashIn))
+
+  command = [sys.executable, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'bootloader_emulator.py'),
+             '--link', link, '--start-in-bootloader', '--flash-in', flashPath,
+             '--block-size', str(args.block_size),
+             '--default-latency', str(args.latency),
+             '--turnaround', str(args.turnaround),
+             '--page-write-time', str(args.page_write_time),
+             '--packet-interval', str(args.packet_interval),
+             '--flash-out', flashOutPath] + faults
+  emulator = subprocess.Popen(command, stdout=subprocess.PIPE)
+  while not os.path.exists(link):
+    time.sleep(0.01)
+
+  client = Client(link, 1)
+  start = time.time()
+
+  # The signature and block size are checked one at a time
+  client.command([ord('s')], 3)
+  client.command([ord('b')], 3)
+  client.finish()
+  client.window = window
+
+  result = Result()
+  if readBack:
+    toWrite = mismatchedPages(client, image, toWrite)
+
+  for address, length in runs(toWrite):
+    client.write(address, length, image, blockSize)
+  result.written = list(toWrite)
+
+  # Verify the pages that were written, and the ones that were skipped without
+  # being read back first. Pages that don't match are written and verified
+  # again, a few times.
+  if verify:
+    verifyPages = toWrite if readBack else dirty
+    while True:
+      result.verifyFailures = mismatchedPages(client, image, verifyPages)
+      if not result.verifyFailures or result.verifyRetries >= VERIFY_RETRIES:
+        break
+      result.verifyRetries += 1
+      for address, length in runs(result.verifyFailures):
+        client.write(address, length, image, blockSize)
+      result.written += result.verifyFailures
+      verifyPages = result.verifyFailures
+
+  client.command([ord('E')], 1)
+  client.finish()
+  elapsed = time.time() - start
+
+  # The emulator saves the flash once the sketch starts again
+  deadline = time.time() + 5
+  while time.time() < deadline:
+    if os.path.exists(flashOutPath) and os.path.getsize(flashOutPath) == FLASH_SIZE:
+      with open(flashOutPath, 'rb') as fp:
+        result.flash = bytearray(fp.read())
+      break
+    time.sleep(0.01)
+
+  emulator.terminate()
+  emulator.wait()
+
+  print('%-44s %4i pages written  %6.2f s' % (name, len(result.written), elapsed))
+  sys.stdout.flush()
+  return result
+
+
+parser = argparse.ArgumentParser(description='Time upload command sequences against the bootloader emulator')
+parser.add_argument('--sketch-length', type=int, default=8332,
+                    help='sketch size in bytes (default 8332, the size of PATTERNPLAYER_DATA)')
+parser.add_argument('--pattern-length', type=int, default=6144, help='pattern data size in bytes (default 6144)')
+parser.add_argument('--block-size', type=int, default=PAGE_SIZE,
+                    help="buffer size the emulated bootloader reports (default 128, like Caterina)")
+parser.add_argument('--latency', type=float, default=0.1,
+                    help='emulator delay before each response, in ms (default 0.1)')
+parser.add_argument('--turnaround', type=float, default=1,
+                    help='emulator time for a command to reach the bootloader, in ms (default 1, one USB frame)')
+parser.add_argument('--page-write-time', type=float, default=4.5,
+                    help='emulator time to erase and write a page, in ms (default 4.5)')
+parser.add_argument('--packet-interval', type=float, default=1,
+                    help='emulator time between response packets, in ms (default 1)')
+parser.add_argument('--window', type=int, default=8, help='commands in flight for the pipelined runs (default 8)')
+args = parser.parse_args()
+
+# The tape holds an earlier upload with the same sketch and a different pattern
+oldImage, _ = buildImage(args.sketch_length, args.pattern_length, 1)
+image, dirty = buildImage(args.sketch_length, args.pattern_length, 2)
+changed = [page for page in dirty if image[page:page + PAGE_SIZE] != oldImage[page:page + PAGE_SIZE]]
+
+failures = []
+
+
+def check(condition, message):
+  if not condition:
+    print('  FAILED: ' + message)
+    failures.append(message)
+
+
+def checkFlash(result):
+  check(result.flash is not None, 'the emulator saved its flash')
+  if result.flash is not None:
+    wrong = [page for page in range(0, FLASH_SIZE, PAGE_SIZE)
+             if result.flash[page:page + PAGE_SIZE] != image[page:page + PAGE_SIZE]]
+    check(not wrong, 'the flash matches the image (%i pages differ)' % len(wrong))
+
+
+print('Image: %i dirty pages, %i changed since the earlier upload' % (len(dirty), len(changed)))
+result = runScenario(args, 'Every page, one command at a time', image, dirty, dirty, oldImage,
+                     False, False, 1, PAGE_SIZE)
+checkFlash(result)
+
+result = runScenario(args, 'Changed pages from the flash record', image, dirty, changed, oldImage,
+                     False, False, 1, PAGE_SIZE)
+check(result.written == changed, 'only the changed pages are written')
+checkFlash(result)
+
+result = runScenario(args, 'No record, read back first', image, dirty, dirty, oldImage,
+                     True, False, 1, PAGE_SIZE)
+check(result.written == changed, 'reading back skips the pages that are already on the device')
+checkFlash(result)
+
+result = runScenario(args, 'Changed pages, %i in flight' % args.window, image, dirty, changed, oldImage,
+                     False, False, args.window, PAGE_SIZE)
+checkFlash(result)
+
+result = runScenario(args, 'Changed pages, %i in flight, %i byte blocks' % (args.window, args.block_size),
+                     image, dirty, changed, oldImage, False, False, args.window, args.block_size)
+checkFlash(result)
+
+result = runScenario(args, 'Changed pages, %i in flight, verified' % args.window, image, dirty, changed, oldImage,
+                     False, True, args.window, args.block_size)
+check(result.verifyRetries == 0, 'nothing is rewritten when every page verifies')
+checkFlash(result)
+
+result = runScenario(args, 'No record, read back, %i in flight, verified' % args.window, image, dirty, dirty, oldImage,
+                     True, True, args.window, args.block_size)
+check(result.written == changed, 'reading back skips the pages that are already on the device')
+checkFlash(result)
+
+# The flash record says the sketch is already there, but the tape was erased
+blank = bytearray([0xFF] * FLASH_SIZE)
+result = runScenario(args, 'Stale flash record, verified', image, dirty, changed, blank,
+                     False, True, args.window, args.block_size)
+check(result.verifyRetries == 1, 'verifying finds the skipped pages that are missing')
+check(not result.verifyFailures, 'the missing pages are written after verifying')
+checkFlash(result)
+
+result = runScenario(args, 'Write faults, verified', image, dirty, changed, oldImage,
+                     False, True, args.window, args.block_size, ['--write-fault-rate', '0.1', '--seed', '1'])
+check(result.verifyRetries > 0, 'verifying finds the pages that were written wrongly')
+check(not result.verifyFailures, 'the wrongly written pages are rewritten')
+checkFlash(result)
+
+result = runScenario(args, 'Every write faulty, verified', image, dirty, changed, oldImage,
+                     False, True, args.window, args.block_size, ['--write-fault-rate', '1'])
+check(result.verifyRetries == VERIFY_RETRIES, 'pages that never verify are retried %i times' % VERIFY_RETRIES)
+check(len(result.verifyFailures) == len(changed), 'every page is reported as failing verification')
+
+if failures:
+  print('%i checks failed' % len(failures))
+  sys.exit(1)
+print('All checks passed')
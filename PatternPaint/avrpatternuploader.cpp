@@ -17,17 +17,49 @@
 /// Length of character buffer for debug messages
 #define BUFF_LENGTH 100
 
+/// Largest block to read back from the flash in one command. Reads are sent
+/// several at a time, so a larger block wouldn't make them much faster, but it
+/// would have to arrive within the command timeout.
+#define READ_BACK_BLOCK_SIZE 1024
+
+/// Number of times to rewrite pages that failed verification, before giving up
+#define VERIFY_RETRY_COUNT 2
+
+/// Number of programmer commands to send before waiting for their responses.
+/// If the link fails while several are in flight, later uploads to the same
+/// device (by USB serial number) fall back to sending one at a time.
+#define PROGRAMMER_WINDOW_SIZE 8
+
 AvrPatternUploader::AvrPatternUploader(QObject *parent) :
-    PatternUploader(parent)
+    PatternUploader(parent),
+    readBackFirst(false),
+    verify(true),
+    verifyRetries(0)
 {
     bootloaderResetTimer = new QTimer(this);
 
     state = State_Ready;
 
     connect(&programmer,SIGNAL(error(QString)),
-            this,SLOT(handleProgrammerError(QString)));
-    connect(&programmer,SIGNAL(commandFinished(QString,QByteArray)),
-            this,SLOT(handleProgrammerCommandFinished(QString,QByteArray)));
+            this,SLOT(handleCommandQueueError(QString)));
+    connect(&programmer,SIGNAL(commandFinished(int,QByteArray)),
+            this,SLOT(handleProgrammerCommandFinished(int,QByteArray)));
+}
+
+void AvrPatternUploader::handleCommandQueueError(QString error) {
+    // If the link failed while several commands were waiting for a response,
+    // the bootloader might not cope with them arriving at once, so send them
+    // one at a time to this device from now on. Other failures, such as a
+    // bootloader that never showed up or pages that didn't verify, keep the
+    // window.
+    int inFlight = programmer.getCommandsInFlight();
+    if(inFlight > 1 && !sequentialDevices.contains(deviceSerialNumber)) {
+        qDebug() << "Upload failed with" << inFlight
+                 << "commands in flight, falling back to 1 for device:" << deviceSerialNumber;
+        sequentialDevices.insert(deviceSerialNumber);
+    }
+
+    handleProgrammerError(error);
 }
 
 void AvrPatternUploader::handleProgrammerError(QString error) {
@@ -40,23 +72,48 @@ void AvrPatternUploader::handleProgrammerError(QString error) {
     emit(finished(false));
 }
 
-void AvrPatternUploader::handleProgrammerCommandFinished(QString command, QByteArray returnData) {
-    Q_UNUSED(returnData);
-
-    // TODO: Update our progress somehow? But how to tell how far we've gotten?
+void AvrPatternUploader::handleProgrammerCommandFinished(int command, QByteArray returnData) {
 //    qDebug() << "Command finished:" << command;
     setProgress(progress + 1);
 
+    if(command == AvrProgrammer::Command_CheckDeviceSignature) {
+        if(sequentialDevices.contains(deviceSerialNumber)) {
+            programmer.setWindowSize(1);
+        }
+        else {
+            programmer.setWindowSize(PROGRAMMER_WINDOW_SIZE);
+        }
+    }
+
+    // The writes are chunked by the block size, so they can only be queued
+    // once it is known.
+    if(command == AvrProgrammer::Command_CheckBlockSupport && state == State_CheckBlockSupport) {
+        queueWrites();
+    }
+
+    if(command == AvrProgrammer::Command_ReadFlash && state == State_ReadBack) {
+        handleReadBack(returnData);
+    }
+
+    if(command == AvrProgrammer::Command_ReadFlash && state == State_Verify) {
+        handleVerify(returnData);
+    }
+
     // we know reset is the last command, so the BlinkyTape should be ready soon.
     // Schedule a timer to emit the message shortly.
     // TODO: Let the receiver handle this instead.
-    if(command == "reset") {
+    if(command == AvrProgrammer::Command_Reset) {
         QTimer::singleShot(PROGRAMMER_RESET_DELAY, this,SLOT(handleResetTimer()));
     }
 }
 
 void AvrPatternUploader::handleResetTimer()
 {
+    // The pages made it to the device, so later uploads can skip them
+    FlashRecord record(deviceSerialNumber);
+    record.addPages(recordedPages);
+    record.save();
+
     emit(finished(true));
 }
 
@@ -69,40 +126,28 @@ void AvrPatternUploader::setMaxProgress(int newMaxProgress) {
     emit(maxProgressChanged(newMaxProgress));
 }
 
+void AvrPatternUploader::setVerify(bool newVerify) {
+    verify = newVerify;
+}
+
+bool AvrPatternUploader::getVerify() const {
+    return verify;
+}
+
 bool AvrPatternUploader::startUpload(BlinkyTape& tape, std::vector<Pattern> patterns) {
-    /// Create the compressed image and check if it will fit into the device memory
+    /// Create the compressed image and check if it will fit into the device memory.
+    /// Each section is checked against the flash size and the other sections as
+    /// it is placed.
     avrUploadData data;
     if(!data.init(patterns)) {
+        qCritical() << data.errorString;
         errorString = data.errorString;
         return false;
     }
 
-    // TODO: Only write the sketch portion if we absolutely have to, to lower the risk
-    // that we trash the firmware if there is a problem later
-
-    // The entire sketch must fit into the available memory, minus a single page
-    // at the end of flash for the configuration header
-    // TODO: Verify this by looking at each section individually instead, making sure
-    // none of them overlap or extend outside of available memory?
-    if(data.sketch.length() + data.patternData.length() + data.patternTable.length() > FLASH_MEMORY_AVAILABLE) {
-        qCritical() << "sketch can't fit into memory!";
-
-        errorString = QString("Sorry! The Pattern is a bit too big to fit in BlinkyTape memory! Avaiable space=%1, Pattern size=%2")
-                              .arg(FLASH_MEMORY_AVAILABLE)
-                              .arg(data.sketch.length() + data.patternData.length() + data.patternTable.length());
-        return false;
-    }
-
-    // Put the sketch, pattern, and metadata into the programming queue.
-    qDebug() << "Sketch address: " << data.sketchAddress << ", size: " << data.sketch.length();
-    qDebug() << "pattern data address: " << data.patternDataAddress << ", size: " << data.patternData.length();
-    qDebug() << "pattern table address: " << data.patternTableAddress << ", size: " << data.patternTable.length();
-
-    flashData.push_back(FlashSection(data.sketchAddress,        data.sketch));
-    flashData.push_back(FlashSection(data.patternDataAddress,  data.patternData));
-    flashData.push_back(FlashSection(data.patternTableAddress, data.patternTable));
-
-    return startUpload(tape);
+    // Only the pages that changed since the last upload are written, so the
+    // sketch is usually left alone.
+    return startUpload(tape, data.image);
 }
 
 
@@ -112,11 +157,10 @@ bool AvrPatternUploader::startUpload(BlinkyTape& tape, QByteArray sketch) {
              sketch.length()),
     qDebug() << buff;
 
-    // The entire sketch must fit into the available memory, minus a single page
-    // at the end of flash for the configuration header
-    // TODO: Could save ~100 bytes if we let the sketch spill into the unused portion
-    // of the header.
-    if(sketch.length() > FLASH_MEMORY_AVAILABLE) {
+    // The entire sketch must fit into the available memory. Without any
+    // patterns, it is free to use the pattern table page as well.
+    FlashImage image;
+    if(!image.addSection("sketch", FLASH_MEMORY_SKETCH_ADDRESS, sketch)) {
         qDebug() << "sketch can't fit into memory!";
 
         errorString = QString("Sorry! The Pattern is a bit too big to fit in BlinkyTape memory right now. We're working on improving this! Avaiable space=%1, Pattern size=%2")
@@ -125,25 +169,64 @@ bool AvrPatternUploader::startUpload(BlinkyTape& tape, QByteArray sketch) {
         return false;
     }
 
-    // Put the sketch, pattern, and metadata into the programming queue.
-    flashData.push_back(FlashSection(0, sketch));
-
-    return startUpload(tape);
+    return startUpload(tape, image);
 }
 
-bool AvrPatternUploader::startUpload(BlinkyTape& tape) {
-    setProgress(0);
-    // TODO: Calculate this based on feedback from the programmer.
-    setMaxProgress(300);
-
-
+bool AvrPatternUploader::startUpload(BlinkyTape& tape, const FlashImage& image) {
     // Now, start the polling processes to detect a new bootloader
     // We can't reset if we weren't already connected...
-    if(!tape.isConnected()) {
+    QSerialPortInfo info;
+    if(!tape.getPortInfo(info)) {
         errorString = "Not connected to a tape, cannot upload again";
         return false;
     }
 
+    // Compare the image against what we last wrote to this tape, and only
+    // queue the pages that are different. If we don't know what is on this
+    // tape, the pages are read back and compared before writing instead.
+    deviceSerialNumber = info.serialNumber();
+    FlashRecord record(deviceSerialNumber);
+    readBackFirst = record.isEmpty();
+
+    imagePages = image.getDirtyPages();
+    unconfirmedPages = imagePages;
+    if(readBackFirst) {
+        pagesToWrite = imagePages;
+    }
+    else {
+        pagesToWrite = record.getChangedPages(image);
+    }
+    recordedPages = pagesToWrite;
+
+    qDebug() << "Pages to write:" << pagesToWrite.size() << "of" << imagePages.size()
+             << "device:" << deviceSerialNumber << "read back first:" << readBackFirst;
+
+    // Forget the old contents of those pages now, in case the upload fails
+    // part way through.
+    record.removePages(recordedPages);
+    record.save();
+
+    verifyRetries = 0;
+
+    // Progress is counted in commands: the signature and block size checks,
+    // an address and a write for each page of each run, and the reset. Reading
+    // back adds an address and a read for each block to write, and verifying
+    // adds them for each block that might need checking. Once the block size
+    // and the pages to write are known, the counts are updated.
+    int commandCount = 3;
+    foreach(const FlashSection& run, FlashImage::mergePages(pagesToWrite)) {
+        commandCount += 1 + run.data.length()/image.pageSize();
+    }
+    if(readBackFirst) {
+        commandCount += readBackCommandCount(pagesToWrite);
+    }
+    if(verify) {
+        commandCount += readBackCommandCount(unconfirmedPages);
+    }
+
+    setProgress(0);
+    setMaxProgress(commandCount);
+
     // Next, tell the tape to reset.
     tape.reset();
 
@@ -204,29 +287,43 @@ void AvrPatternUploader::doWork() {
                 return;
             }
 
-            // Try to create a new programmer by connecting to the port
-            if(!programmer.open(postResetTapes.at(0))) {
+            // Try to create a new programmer by connecting to the port. The
+            // override port might not be known to QSerialPortInfo, in which
+            // case it is reported as a null port, so open it by name.
+            bool opened;
+            if(postResetTapes.at(0).isNull()) {
+                opened = programmer.open(BlinkyTape::getPortOverride());
+            }
+            else {
+                opened = programmer.open(postResetTapes.at(0));
+            }
+
+            if(!opened) {
                 handleProgrammerError("could not connect to programmer!");
                 return;
             }
 
             qDebug() << "Connected to programmer!";
 
+            // Send one command at a time until we know that this is the right
+            // device, so that nothing is written to anything else.
+            programmer.setWindowSize(1);
+
             // Send Check Device Signature command
             programmer.checkDeviceSignature();
 
-            // Queue all of the flash sections to memory
-            while(!flashData.empty()) {
-                FlashSection f = flashData.front();
-                programmer.writeFlash(f.data, f.address);
-                flashData.pop_front();
-            }
-
-            // TODO: Add verify stage?
+            // Find out how much data the bootloader can take in one write
+            programmer.checkBlockSupport();
 
-            programmer.reset();
+            // The writes are queued once the read back is finished, or else
+            // once the block size is known
+            if(readBackFirst && !pagesToWrite.isEmpty()) {
+                queueReadBack(pagesToWrite);
+                state = State_ReadBack;
+                break;
+            }
 
-            state = State_Ready;
+            state = State_CheckBlockSupport;
         }
         break;
 
@@ -235,3 +332,164 @@ void AvrPatternUploader::doWork() {
     }
 
 }
+
+void AvrPatternUploader::queueReadBack(const QMap<int, QByteArray>& pages) {
+    readBackQueue.clear();
+
+    foreach(const FlashSection& run, FlashImage::mergePages(pages)) {
+        for(int offset = 0; offset < run.data.length(); offset += READ_BACK_BLOCK_SIZE) {
+            FlashSection block(run.address + offset, run.data.mid(offset, READ_BACK_BLOCK_SIZE));
+
+            readBackQueue.push_back(block);
+            programmer.readFlash(block.address, block.data.length());
+        }
+    }
+}
+
+int AvrPatternUploader::readBackCommandCount(const QMap<int, QByteArray>& pages) {
+    int commandCount = 0;
+    foreach(const FlashSection& run, FlashImage::mergePages(pages)) {
+        commandCount += 2*((run.data.length() + READ_BACK_BLOCK_SIZE - 1)/READ_BACK_BLOCK_SIZE);
+    }
+    return commandCount;
+}
+
+QList<int> AvrPatternUploader::findMismatchedPages(const FlashSection& block,
+                                                   const QByteArray& data) {
+    QList<int> mismatched;
+
+    // Most blocks match completely, so check the whole block before
+    // looking at each page
+    if(data == block.data) {
+        return mismatched;
+    }
+
+    for(int offset = 0; offset < block.data.length(); offset += FLASH_MEMORY_PAGE_SIZE) {
+        if(data.mid(offset, FLASH_MEMORY_PAGE_SIZE) != block.data.mid(offset, FLASH_MEMORY_PAGE_SIZE)) {
+            mismatched.append(block.address + offset);
+        }
+    }
+
+    return mismatched;
+}
+
+void AvrPatternUploader::handleReadBack(const QByteArray& data) {
+    if(readBackQueue.isEmpty()) {
+        qCritical() << "Got read back data that wasn't asked for";
+        return;
+    }
+
+    FlashSection block = readBackQueue.front();
+    readBackQueue.pop_front();
+
+    // Pages that already hold the right data don't need to be written, or
+    // checked again afterwards
+    QList<int> mismatched = findMismatchedPages(block, data);
+    for(int offset = 0; offset < block.data.length(); offset += FLASH_MEMORY_PAGE_SIZE) {
+        if(!mismatched.contains(block.address + offset)) {
+            pagesToWrite.remove(block.address + offset);
+            unconfirmedPages.remove(block.address + offset);
+        }
+    }
+
+    if(!readBackQueue.isEmpty()) {
+        return;
+    }
+
+    qDebug() << "Read back finished, pages to write:" << pagesToWrite.size()
+             << "of" << recordedPages.size();
+
+    queueWrites();
+}
+
+void AvrPatternUploader::queueWrites() {
+    // Put the pages that hold the sketch, pattern, and metadata into the
+    // programming queue.
+    QList<FlashSection> runs = FlashImage::mergePages(pagesToWrite);
+
+    // The first verify pass checks every page that wasn't already confirmed
+    // by the read back, and the retries only check the pages that were
+    // written again.
+    const QMap<int, QByteArray>& verifyPages = (verifyRetries == 0) ? unconfirmedPages : pagesToWrite;
+
+    int blockSize = programmer.getBlockSize();
+    int commandCount = 1;
+    foreach(const FlashSection& run, runs) {
+        commandCount += 1 + (run.data.length() + blockSize - 1)/blockSize;
+    }
+    if(verify) {
+        commandCount += readBackCommandCount(verifyPages);
+    }
+    setMaxProgress(progress + commandCount);
+
+    for(int index = 0; index < runs.length(); index++) {
+        qDebug() << "Flash address:" << runs[index].address << ", size:" << runs[index].data.length();
+        programmer.writeFlash(runs[index].data, runs[index].address);
+    }
+
+    // Read the pages back once they are written. The reads are queued behind
+    // the writes, so they can go out while the last writes finish.
+    if(verify && !verifyPages.isEmpty()) {
+        verifyFailures.clear();
+        queueReadBack(verifyPages);
+        state = State_Verify;
+        return;
+    }
+
+    programmer.reset();
+    state = State_Ready;
+}
+
+void AvrPatternUploader::handleVerify(const QByteArray& data) {
+    if(readBackQueue.isEmpty()) {
+        qCritical() << "Got verify data that wasn't asked for";
+        return;
+    }
+
+    FlashSection block = readBackQueue.front();
+    readBackQueue.pop_front();
+
+    foreach(int address, findMismatchedPages(block, data)) {
+        verifyFailures.insert(address, imagePages.value(address));
+
+        // The record said this page was already on the tape, so it can't be
+        // trusted for the others either.
+        if(!recordedPages.contains(address)) {
+            qDebug() << "Skipped page doesn't match the flash record:" << address;
+            FlashRecord record(deviceSerialNumber);
+            record.clear();
+            record.save();
+            recordedPages.insert(address, imagePages.value(address));
+        }
+    }
+
+    if(!readBackQueue.isEmpty()) {
+        return;
+    }
+
+    if(verifyFailures.isEmpty()) {
+        qDebug() << "Verify finished, all pages match";
+
+        // Every page of the image has now been read back and checked, either
+        // before writing or here, so all of them can be recorded, even if the
+        // record was cleared along the way.
+        recordedPages = imagePages;
+
+        programmer.reset();
+        state = State_Ready;
+        return;
+    }
+
+    qDebug() << "Verify failed for" << verifyFailures.size() << "pages";
+
+    if(verifyRetries >= VERIFY_RETRY_COUNT) {
+        handleProgrammerError(QString("Flash verification failed, %1 pages could not be written")
+                              .arg(verifyFailures.size()));
+        return;
+    }
+    verifyRetries++;
+
+    // Write only the pages that didn't match, then verify those again
+    pagesToWrite = verifyFailures;
+    queueWrites();
+}
@@ -3,21 +3,14 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QSet>
 #include <iostream>
 #include "pattern.h"
 #include "avrprogrammer.h"
 #include "blinkytape.h"
 #include "patternuploader.h"
-
-struct FlashSection {
-    FlashSection(int address,
-                 QByteArray data) :
-        address(address),
-        data(data) {}
-
-    int address;
-    QByteArray data;
-};
+#include "flashimage.h"
+#include "flashrecord.h"
 
 /// This is an re-entreant version of an pattern uploader.
 /// Each task in the upload process is broken into a single state, and the state
@@ -54,12 +47,23 @@ public:
     /// Get a string describing the last error, if any.
     QString getErrorString() const;
 
+    /// Set whether the flash is read back and checked after it is written.
+    /// Pages that don't match are written again.
+    void setVerify(bool verify);
+
+    /// True if the flash is checked after it is written
+    bool getVerify() const;
+
 private slots:
     void doWork();  /// Handle the next section of work, whatever it is
 
+    /// Handle an error from the programmer's command queue: a serial error,
+    /// or a command that timed out
+    void handleCommandQueueError(QString error);
+
     void handleProgrammerError(QString error);
 
-    void handleProgrammerCommandFinished(QString command, QByteArray returnData);
+    void handleProgrammerCommandFinished(int command, QByteArray returnData);
 
     /// Delay timer, lets us wait some time between receiving a finished command, and
     /// passing the message along (to give the serial device some time to reset itself).
@@ -70,12 +74,52 @@ private:
         State_Ready,                    ///< Ready for a command.
         State_WaitForBootloaderPort,    ///< We are waiting for the bootloader device to show up.
         State_WaitAfterBootloaderPort,  ///< Short delay after the device shows up
+        State_CheckBlockSupport,        ///< Waiting for the bootloader to report its block size
+        State_ReadBack,                 ///< Reading the flash, to find pages that are already correct
+        State_Verify,                   ///< Reading the flash, to check that the pages were written
     };
 
     /// Start an upload, using the passed blinkytape as a launching point
     /// Note that the blinkytape will be disconnected during the upload process,
     /// and will need to be reconnected manually afterwards.
-    bool startUpload(BlinkyTape& tape);
+    /// @param image Flash image to write. Only the pages that hold section
+    /// data, and that differ from the last upload to this tape, are written.
+    /// If there is no record of the last upload, the pages are read back from
+    /// the tape and compared instead.
+    bool startUpload(BlinkyTape& tape, const FlashImage& image);
+
+    /// Queue reads of a set of pages, in blocks of up to READ_BACK_BLOCK_SIZE
+    /// @param pages Pages to read, by page address
+    void queueReadBack(const QMap<int, QByteArray>& pages);
+
+    /// Count the commands needed to read back a set of pages
+    static int readBackCommandCount(const QMap<int, QByteArray>& pages);
+
+    /// Compare a block that was read back against the image, and drop the
+    /// pages that already match from the pages to write
+    /// @param data Data read from the flash
+    void handleReadBack(const QByteArray& data);
+
+    /// Find the pages in a block that don't match the data read from the flash
+    /// @param block Address of the block, and what the image has for it
+    /// @param data Data read from the flash
+    /// @return Address of each page that doesn't match
+    static QList<int> findMismatchedPages(const FlashSection& block, const QByteArray& data);
+
+    /// Queue writes for the pages that need to be written, then either the
+    /// reads to verify them, or the reset
+    void queueWrites();
+
+    /// Compare a block that was read back after writing against the image.
+    /// The first pass checks the pages that were written, and the ones that
+    /// were skipped because the flash record said they were already there
+    /// (pages that were read back and matched before writing are already
+    /// known to be good). If a skipped page doesn't match, the record is
+    /// wrong, so it is cleared.
+    /// Once every block is checked, pages that don't match are written again,
+    /// or the upload fails if they have already been retried too often.
+    /// @param data Data read from the flash
+    void handleVerify(const QByteArray& data);
 
     /// Timer used to poll for the bootloader device to show up
     QPointer<QTimer> bootloaderResetTimer;
@@ -99,7 +143,20 @@ private:
 
     AvrProgrammer programmer;
 
-    QQueue<FlashSection> flashData; ///< Queue of memory sections to write
+    QString deviceSerialNumber;             ///< USB serial number of the tape being written
+    QMap<int, QByteArray> imagePages;       ///< Every page of the image that holds data
+    QMap<int, QByteArray> unconfirmedPages; ///< Pages of the image that haven't been read back and found correct
+    QMap<int, QByteArray> pagesToWrite;     ///< Pages that need to be written
+    QMap<int, QByteArray> recordedPages;    ///< Pages to record once the upload succeeds
+
+    bool readBackFirst;                     ///< True if the flash should be read and compared before writing
+    QQueue<FlashSection> readBackQueue;     ///< Blocks being read back, and what the image has for them
+
+    bool verify;                            ///< True if the flash should be read and checked after writing
+    int verifyRetries;                      ///< Number of times pages were rewritten after failing verification
+    QMap<int, QByteArray> verifyFailures;   ///< Pages that didn't match when they were verified
+
+    QSet<QString> sequentialDevices;        ///< USB serial numbers of devices that failed with several commands in flight
 };
 
 #endif // AVRPATTERNUPLOADER_H
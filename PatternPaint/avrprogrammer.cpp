@@ -3,19 +3,93 @@
 
 #define PAGE_SIZE_BYTES 128
 
+/// Parser for the response to the block support query: 'Y' followed by the
+/// buffer size (high, low), or '?' if the bootloader doesn't have block mode.
+class BlockSupportResponseParser : public ResponseParser
+{
+public:
+    Status parse(QByteArray& data) {
+        if(data.isEmpty()) {
+            return Status_Incomplete;
+        }
+
+        int length = (data.at(0) == '?') ? 1 : 3;
+        if(data.length() < length) {
+            return Status_Incomplete;
+        }
+
+        response = data.left(length);
+        data.remove(0, length);
+        return Status_Complete;
+    }
+};
+
 AvrProgrammer::AvrProgrammer(QObject *parent) :
-    SerialCommandQueue(parent)
+    SerialCommandQueue(parent),
+    blockSize(PAGE_SIZE_BYTES)
 {
 }
 
 // Send the command to probe for the device signature, and register the expected response
 void AvrProgrammer::checkDeviceSignature() {
-    queueCommand("checkDeviceSignature",QByteArray("s"), QByteArray("\x87\x95\x1E"));
+    queueCommand(SerialCommand(Command_CheckDeviceSignature, "checkDeviceSignature",
+                               QByteArray("s"),
+                               new ExactResponseParser(QByteArray("\x87\x95\x1E"))));
+}
+
+void AvrProgrammer::checkBlockSupport() {
+    // Assume the page size until the bootloader says otherwise
+    blockSize = PAGE_SIZE_BYTES;
+
+    SerialCommand command(Command_CheckBlockSupport, "checkBlockSupport",
+                          QByteArray("b"),
+                          new BlockSupportResponseParser());
+
+    // Update the block size before anyone else hears that the command finished
+    command.setCompletionHandler(this, "handleBlockSupport");
+
+    queueCommand(command);
+}
+
+int AvrProgrammer::getBlockSize() const {
+    return blockSize;
+}
+
+void AvrProgrammer::setBlockSize(int size) {
+    // Each block has to end on a page boundary, otherwise the bootloader
+    // writes a partial page and the next block starts in the middle of it
+    size -= size % PAGE_SIZE_BYTES;
+
+    if(size <= 0) {
+        size = PAGE_SIZE_BYTES;
+    }
+
+    blockSize = size;
+}
+
+void AvrProgrammer::handleBlockSupport(QByteArray returnData) {
+    if(returnData.length() != 3 || returnData.at(0) != 'Y') {
+        qDebug() << "Block mode not supported, using the page size";
+        setBlockSize(PAGE_SIZE_BYTES);
+        return;
+    }
+
+    setBlockSize((static_cast<uchar>(returnData.at(1)) << 8)
+                 + static_cast<uchar>(returnData.at(2)));
+    qDebug() << "Bootloader block size:" << blockSize;
 }
 
 void AvrProgrammer::reset()
 {
-    queueCommand("reset",QByteArray("E"), QByteArray("\r"));
+    SerialCommand command(Command_Reset, "reset",
+                          QByteArray("E"),
+                          new ExactResponseParser(QByteArray("\r")));
+
+    // The bootloader starts the user program after a reset, so it won't
+    // answer any more commands
+    command.endsSession = true;
+
+    queueCommand(command);
 }
 
 void AvrProgrammer::setAddress(int address) {
@@ -31,7 +105,8 @@ void AvrProgrammer::setAddress(int address) {
     command.append((address >> 9) & 0xFF);
     command.append((address >> 1) & 0xFF);
 
-    queueCommand("setAddress", command, QByteArray("\r"));
+    queueCommand(SerialCommand(Command_SetAddress, "setAddress", command,
+                               new ExactResponseParser(QByteArray("\r"))));
 }
 
 void AvrProgrammer::readFlash(int startAddress, int lengthBytes) {
@@ -47,9 +122,9 @@ void AvrProgrammer::readFlash(int startAddress, int lengthBytes) {
     command.append((lengthBytes)      & 0xFF); // read size (low)
     command.append('F'); // memory type: flash
 
-    // Note: only the length matters for the response, the response data
-    // will be ignored.
-    queueCommand("readFlash",command,QByteArray(lengthBytes + 1, '\r'));
+    // The bootloader sends the flash contents back with no terminator.
+    queueCommand(SerialCommand(Command_ReadFlash, "readFlash", command,
+                               new FixedLengthResponseParser(lengthBytes)));
 }
 
 void AvrProgrammer::writeFlash(QByteArray& data, int startAddress) {
@@ -73,12 +148,12 @@ void AvrProgrammer::writeFlash(QByteArray& data, int startAddress) {
 
     setAddress(startAddress);
 
-    // Write the data in page-sized chunks
+    // Write the data in chunks as large as the bootloader's buffer
     for(int currentChunkPosition = 0;
         currentChunkPosition < data.length();
-        currentChunkPosition += PAGE_SIZE_BYTES) {
+        currentChunkPosition += blockSize) {
 
-        int currentChunkSize = std::min(PAGE_SIZE_BYTES, data.length() - currentChunkPosition);
+        int currentChunkSize = std::min(blockSize, data.length() - currentChunkPosition);
 
         QByteArray command;
         command.append('B'); // command: write memory
@@ -87,6 +162,7 @@ void AvrProgrammer::writeFlash(QByteArray& data, int startAddress) {
         command.append('F'); // memory type: flash
         command.append(data.mid(currentChunkPosition,currentChunkSize));
 
-        queueCommand("writeFlash", command, QByteArray("\r"));
+        queueCommand(SerialCommand(Command_WriteFlash, "writeFlash", command,
+                                   new ExactResponseParser(QByteArray("\r"))));
     }
 }
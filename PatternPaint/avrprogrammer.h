@@ -9,6 +9,16 @@ class AvrProgrammer : public SerialCommandQueue
 {
     Q_OBJECT
 public:
+    /// Type tags for the commands, reported by commandFinished()
+    enum CommandType {
+        Command_CheckDeviceSignature,
+        Command_CheckBlockSupport,
+        Command_SetAddress,
+        Command_ReadFlash,
+        Command_WriteFlash,
+        Command_Reset,
+    };
+
     explicit AvrProgrammer(QObject *parent = 0);
 
     /// Read the contents of the flash
@@ -17,6 +27,8 @@ public:
     void readFlash(int startAddress, int lengthBytes);
 
     /// Write the contents of the flash
+    /// The data is sent in chunks of the block size (see getBlockSize()), so the
+    /// block size should be known before the write is queued.
     /// Note that if length is not a multiple of the page size, some pre-existing
     /// data at the end may be erased.
     /// @param data QByteArray containing the data to write to the flash
@@ -35,8 +47,28 @@ public:
     /// Check that we are talking to the correct device
     void checkDeviceSignature();
 
+    /// Ask the bootloader if it supports block mode, and how large its buffer
+    /// is. Once the command finishes, getBlockSize() returns the reported size,
+    /// or the page size if block mode isn't supported.
+    void checkBlockSupport();
+
     /// Instruct the programmer to reset.
     void reset();
+
+    /// Get the largest chunk that writeFlash() sends in one command, in bytes
+    int getBlockSize() const;
+
+    /// Set the largest chunk that writeFlash() sends in one command
+    /// @param size Block size, in bytes. Rounded down to a whole number of
+    /// pages; sizes smaller than a page fall back to the page size.
+    void setBlockSize(int size);
+
+private slots:
+    /// Pick up the block size from the bootloader's response
+    void handleBlockSupport(QByteArray returnData);
+
+private:
+    int blockSize;  ///< Largest chunk to write in one command, in bytes
 };
 
 #endif // AVRPROGRAMMER_H
@@ -8,24 +8,51 @@
 #define PATTERN_TABLE_ENTRY_LENGTH      7
 
 
-bool avrUploadData::init(std::vector<Pattern> patterns) {
-    char buff[BUFF_LENGTH];
-    QString errorString;
+// The sketch has to end before the pattern table page
+Q_STATIC_ASSERT(sizeof(PATTERNPLAYER_DATA) <= FLASH_MEMORY_PATTERN_TABLE_ADDRESS - FLASH_MEMORY_SKETCH_ADDRESS);
+
+// Place the sketch and an empty pattern table, which have fixed locations.
+// The table only takes as much of its page as it needs, so that pattern data
+// can use the rest.
+static bool addFixedSections(FlashImage& image, int patternCount) {
+    // The sketch isn't padded out to a page boundary; pattern data can share
+    // its last page. Whole pages are written from the image, so each page
+    // gets both. The sketch data is static, so it doesn't need to be copied.
+    QByteArray sketch = QByteArray::fromRawData(
+                reinterpret_cast<const char*>(PATTERNPLAYER_DATA), sizeof(PATTERNPLAYER_DATA));
+
+    int patternTableLength = PATTERN_TABLE_HEADER_LENGTH
+            + patternCount*PATTERN_TABLE_ENTRY_LENGTH;
+
+    return image.addSection("sketch", FLASH_MEMORY_SKETCH_ADDRESS, sketch)
+            && image.addSection("pattern table", FLASH_MEMORY_PATTERN_TABLE_ADDRESS,
+                                QByteArray(patternTableLength, static_cast<char>(0xFF)));
+}
 
-    // We need to build two things- a memory image containing the sketch and pattern data,
-    // and a memory image containing the pattern data information table.
+int avrUploadData::availablePatternSpace() {
+    // A pattern can go between the sketch and the pattern table, or in the
+    // rest of the pattern table page, whichever is larger.
+    FlashImage image;
+    if(!addFixedSections(image, 1)) {
+        return 0;
+    }
 
-    sketch = QByteArray();          // Program data
-    patternData = QByteArray();     // Pattern Data
-    patternTable = QByteArray();    // Pattern data header
+    return image.largestFreeSpace();
+}
 
-    sketch.append(reinterpret_cast<const char*>(PATTERNPLAYER_DATA), sizeof(PATTERNPLAYER_DATA));
+bool avrUploadData::isEncodingSupported(Pattern::Encoding encoding) {
+    // The sketch only plays the encodings that the Animation library knows
+    // about. The newer ones need a decoder in the sketch, and a rebuilt
+    // PatternPlayer_Sketch.h, before they can be added here.
+    return encoding <= Pattern::INDEXED_RLE;
+}
 
-    // Expand sketch size to FLASH_MEMORY_PAGE_SIZE boundary
-    while(sketch.length() % FLASH_MEMORY_PAGE_SIZE != 0) {
-        sketch.append(static_cast<char>(0xFF));
-    }
+bool avrUploadData::init(std::vector<Pattern> patterns) {
+    char buff[BUFF_LENGTH];
 
+    // We need to build a memory image containing the sketch, the pattern data,
+    // and the pattern table that describes where each pattern is.
+    image = FlashImage();
 
     // Test for the minimum/maximum patterns size
     if(patterns.size() == 0) {
@@ -37,57 +64,94 @@ bool avrUploadData::init(std::vector<Pattern> patterns) {
         return false;
     }
 
+    // The pattern table is filled in once the pattern data has been placed.
+    if(!addFixedSections(image, static_cast<int>(patterns.size()))) {
+        errorString = image.getErrorString();
+        return false;
+    }
+
     snprintf(buff, BUFF_LENGTH, "Building pattern array. Pattern Count: %zu, led count: %i",
              patterns.size(),
              patterns[0].ledCount);
     qDebug() << buff;
 
+    QByteArray patternTable;
     patternTable.append(static_cast<char>(patterns.size()));       // First byte of the metadata is how many patterns there are
     patternTable.append(static_cast<char>(patterns[0].ledCount));  // Second byte is the length of the LED strip
     // TODO: make the LED count to a separate, explicit parameter?
 
-    int dataOffset = sketch.length();
-
-    // Now, for each pattern, append the image data to the sketch
     for(std::vector<Pattern>::iterator pattern = patterns.begin(); pattern != patterns.end(); ++pattern) {
+        if(!pattern->valid) {
+            errorString = QString("The pattern could not be stored in encoding %1.")
+                    .arg(pattern->encoding);
+            return false;
+        }
+
+        if(!isEncodingSupported(pattern->encoding)) {
+            errorString = QString("The pattern player does not support encoding %1.")
+                    .arg(pattern->encoding);
+            return false;
+        }
+    }
+
+    // Place the largest blocks of data first, each into the smallest gap that
+    // fits it. The gaps are the space between the sketch and the pattern
+    // table, and the rest of the pattern table page. Every address in the
+    // pattern table is absolute, so the player doesn't care where they go.
+    QMap<int, QList<int> > placementOrder;  // Pattern indexes, by size
+    for(unsigned int index = 0; index < patterns.size(); index++) {
+        placementOrder[-patterns[index].data.length()].append(index);
+    }
+
+    QVector<int> dataOffsets(patterns.size(), -1);
+
+    foreach(const QList<int>& sameSize, placementOrder) {
+        foreach(int index, sameSize) {
+            dataOffsets[index] = image.allocateSection(QString("pattern %1").arg(index),
+                                                       patterns[index].data, 1);
+            if(dataOffsets[index] < 0) {
+                errorString = QString("Sorry! The Pattern is a bit too big to fit in BlinkyTape memory! %1")
+                        .arg(image.getErrorString());
+                return false;
+            }
+        }
+    }
+
+    // Now, build the table entry for each pattern
+    for(unsigned int index = 0; index < patterns.size(); index++) {
+        const Pattern& pattern = patterns[index];
+        int dataOffset = dataOffsets[index];
+
         snprintf(buff, BUFF_LENGTH, "Adding pattern. Encoding: %x, framecount: %i, frameDelay: %i, size: %iB, offset: %iB",
-                 pattern->encoding,
-                 pattern->frameCount,
-                 pattern->frameDelay,
-                 pattern->data.length(),
+                 pattern.encoding,
+                 pattern.frameCount,
+                 pattern.frameDelay,
+                 pattern.data.length(),
                  dataOffset);
         qDebug() << buff;
 
         // Build the table entry for this pattern
-        patternTable.append(static_cast<char>((pattern->encoding) & 0xFF));             // Offset 0: encoding (1 byte)
-        patternTable.append(static_cast<char>((dataOffset >> 8) & 0xFF));               // Offset 1: memory location (2 bytes)
+        patternTable.append(static_cast<char>((pattern.encoding) & 0xFF));             // Offset 0: encoding (1 byte)
+        patternTable.append(static_cast<char>((dataOffset >> 8) & 0xFF));              // Offset 1: memory location (2 bytes)
         patternTable.append(static_cast<char>((dataOffset     ) & 0xFF));
-        patternTable.append(static_cast<char>((pattern->frameCount >> 8  ) & 0xFF));    // Offset 3: frame count (2 bytes)
-        patternTable.append(static_cast<char>((pattern->frameCount       ) & 0xFF));
-        patternTable.append(static_cast<char>((pattern->frameDelay >> 8  ) & 0xFF));    // Offset 5: frame delay (2 bytes)
-        patternTable.append(static_cast<char>((pattern->frameDelay       ) & 0xFF));
-
-        // and append the image data
-        patternData += pattern->data;
-        dataOffset += pattern->data.length();
+        patternTable.append(static_cast<char>((pattern.frameCount >> 8  ) & 0xFF));    // Offset 3: frame count (2 bytes)
+        patternTable.append(static_cast<char>((pattern.frameCount       ) & 0xFF));
+        patternTable.append(static_cast<char>((pattern.frameDelay >> 8  ) & 0xFF));    // Offset 5: frame delay (2 bytes)
+        patternTable.append(static_cast<char>((pattern.frameDelay       ) & 0xFF));
     }
 
-    // Pad pattern table to FLASH_MEMORY_PAGE_SIZE bytes.
-    while(patternTable.length() < FLASH_MEMORY_PAGE_SIZE) {
-        patternTable.append(static_cast<char>(0xFF));
+    if(!image.updateSection("pattern table", patternTable)) {
+        errorString = image.getErrorString();
+        return false;
     }
 
-    snprintf(buff, BUFF_LENGTH, "Sketch size: %iB, pattern data size: %iB, pattern table size: %iB",
-             sketch.length(),
-             patternData.length(),
-             patternTable.length());
-    qDebug() << buff;
-
-
-    sketchAddress = FLASH_MEMORY_SKETCH_ADDRESS;
-    patternDataAddress = FLASH_MEMORY_SKETCH_ADDRESS + sketch.length();
-    patternTableAddress = FLASH_MEMORY_PATTERN_TABLE_ADDRESS;
+    foreach(const FlashImage::Section& section, image.getSections()) {
+        snprintf(buff, BUFF_LENGTH, "Section: %s, address: 0x%04x, size: %iB",
+                 section.name.toLocal8Bit().constData(),
+                 section.address,
+                 section.data.length());
+        qDebug() << buff;
+    }
 
     return true;
 }
-
@@ -4,19 +4,28 @@
 #include <QByteArray>
 #include <vector>
 #include "pattern.h"
+#include "flashimage.h"
 
-/// Memory class to
+/// Lay out the flash for the PatternPlayer sketch: the sketch itself, the
+/// pattern data, and the pattern table that tells the sketch where each
+/// pattern is.
 class avrUploadData {
 public:
+    /// Lay out the flash for a set of patterns
+    /// @param patterns Patterns to upload
     bool init(std::vector<Pattern> patterns);
 
-    QByteArray sketch;
-    QByteArray patternData;
-    QByteArray patternTable;
+    /// Get the size of the largest pattern that can be uploaded on its own,
+    /// once the sketch and pattern table have been placed.
+    /// @return Size of the largest free space in the flash, in bytes
+    static int availablePatternSpace();
 
-    int sketchAddress;
-    int patternDataAddress;
-    int patternTableAddress;
+    /// Check if the bundled PatternPlayer sketch can decode an encoding
+    /// @param encoding Encoding to check
+    /// @return true if patterns in this encoding can be uploaded
+    static bool isEncodingSupported(Pattern::Encoding encoding);
+
+    FlashImage image;   ///< Sketch, pattern data and pattern table sections
 
     QString errorString;
 };
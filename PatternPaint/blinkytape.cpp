@@ -1,6 +1,7 @@
 #include "avrprogrammer.h"
 #include "blinkytape.h"
 #include <QDebug>
+#include <QFile>
 
 /// Interval between scans to see if the device is still connected
 #define CONNECTION_SCANNER_INTERVAL 100
@@ -10,9 +11,34 @@
 
 #define RESET_MAX_TRIES 3
 
+QString BlinkyTape::getPortOverride()
+{
+    return QString::fromLocal8Bit(qgetenv(BLINKYTAPE_PORT_OVERRIDE_VARIABLE));
+}
+
+/// Find the override port, if it is set and currently exists
+static QList<QSerialPortInfo> findOverridePort()
+{
+    QList<QSerialPortInfo> tapes;
+    QString portName = BlinkyTape::getPortOverride();
+
+    // A device that is resetting disappears for a moment, so only report the
+    // port while it is there.
+    if(QSerialPortInfo(portName).isNull() && !QFile::exists(portName)) {
+        return tapes;
+    }
+
+    tapes.push_back(QSerialPortInfo(portName));
+    return tapes;
+}
+
 // TODO: Support a method for loading these from preferences file
 QList<QSerialPortInfo> BlinkyTape::findBlinkyTapes()
 {
+    if(!getPortOverride().isEmpty()) {
+        return findOverridePort();
+    }
+
     QList<QSerialPortInfo> serialPorts = QSerialPortInfo::availablePorts();
     QList<QSerialPortInfo> tapes;
 
@@ -40,6 +66,10 @@ QList<QSerialPortInfo> BlinkyTape::findBlinkyTapes()
 // TODO: Support a method for loading these from preferences file
 QList<QSerialPortInfo> BlinkyTape::findBlinkyTapeBootloaders()
 {
+    if(!getPortOverride().isEmpty()) {
+        return findOverridePort();
+    }
+
     QList<QSerialPortInfo> serialPorts = QSerialPortInfo::availablePorts();
     QList<QSerialPortInfo> tapes;
 
@@ -169,6 +199,9 @@ bool BlinkyTape::open(QSerialPortInfo info) {
 #else
     serial->setPortName(info.portName());
 #endif
+    if(info.isNull()) {
+        serial->setPortName(getPortOverride());
+    }
     serial->setBaudRate(QSerialPort::Baud115200);
 
     if( !serial->open(QIODevice::ReadWrite) ) {
@@ -238,13 +271,6 @@ void BlinkyTape::sendUpdate(QByteArray LedData)
         return;
     }
 
-    // Trim anything that's 0xff
-    for(int i = 0; i < LedData.length(); i++) {
-        if(LedData[i] == (char)255) {
-            LedData[i] = 254;
-        }
-    }
-
     // Append an 0xFF to signal the flip command
     LedData.append(0xFF);
 
@@ -27,6 +27,12 @@
 #define LIGHT_BUDDY_BOOTLOADER_VID      0x1D50
 #define LIGHT_BUDDY_BOOTLOADER_PID      0x60A9
 
+/// Environment variable naming a serial port to use as the BlinkyTape, and as
+/// its bootloader, instead of searching by USB VID/PID. This is for ports that
+/// have no USB IDs, such as the pseudo-terminal made by the bootloader emulator
+/// in PatternPlayer_Sketch.
+#define BLINKYTAPE_PORT_OVERRIDE_VARIABLE "PATTERNPAINT_TAPE_PORT"
+
 /// Connect to a BlinkyTape over a serial port, and manage sending data to it.
 class BlinkyTape : public QObject
 {
@@ -35,6 +41,14 @@ public:
     static QList<QSerialPortInfo> findBlinkyTapes();
     static QList<QSerialPortInfo> findBlinkyTapeBootloaders();
 
+    /// Get the port named by BLINKYTAPE_PORT_OVERRIDE_VARIABLE, if it is set.
+    /// While it is set, it is the only port that findBlinkyTapes() and
+    /// findBlinkyTapeBootloaders() report, and only while it exists. A port
+    /// that QSerialPortInfo doesn't know about is reported as a null
+    /// QSerialPortInfo, which has to be opened by this name instead.
+    /// @return Port name or path, or an empty string if there is no override
+    static QString getPortOverride();
+
     BlinkyTape(QObject *parent);
 
     // TODO: Destructor!
@@ -43,6 +57,10 @@ public:
 
     bool open(QSerialPortInfo info);
 
+    /// Send a frame of LED data to the tape.
+    /// Note that 0xFF is used as the frame marker, so the color data must not
+    /// contain it. ColorModel::correctBrightness() in streaming mode ensures this.
+    /// @param colors Packed RGB24 color data
     void sendUpdate(QByteArray colors);
 
     bool getPortInfo(QSerialPortInfo &info);
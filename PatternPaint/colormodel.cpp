@@ -1,12 +1,97 @@
 #include "colormodel.h"
 
+#include <QAtomicInt>
 #include <cmath>
 
-QRgb ColorModel::correctBrightness(QRgb uncorrected)
+struct GammaProfile {
+    double red;
+    double green;
+    double blue;
+};
+
+static const GammaProfile gammaProfiles[ColorModel::PROFILE_COUNT] = {
+    {1.8, 1.8, 2.1},    // PROFILE_BLINKYTAPE
+    {2.2, 2.2, 2.2},    // PROFILE_GAMMA_2_2
+    {1.0, 1.0, 1.0},    // PROFILE_LINEAR
+};
+
+/// Lookup tables for each profile, so that correction doesn't need to call pow()
+struct CorrectionTables {
+    CorrectionTables() {
+        for(int profile = 0; profile < ColorModel::PROFILE_COUNT; profile++) {
+            for(int value = 0; value < 256; value++) {
+                red[profile][value]   = int(255*pow(value/255.0, gammaProfiles[profile].red));
+                green[profile][value] = int(255*pow(value/255.0, gammaProfiles[profile].green));
+                blue[profile][value]  = int(255*pow(value/255.0, gammaProfiles[profile].blue));
+
+                streamingRed[profile][value]   = qMin(int(red[profile][value]),   254);
+                streamingGreen[profile][value] = qMin(int(green[profile][value]), 254);
+                streamingBlue[profile][value]  = qMin(int(blue[profile][value]),  254);
+            }
+        }
+    }
+
+    uchar red[ColorModel::PROFILE_COUNT][256];
+    uchar green[ColorModel::PROFILE_COUNT][256];
+    uchar blue[ColorModel::PROFILE_COUNT][256];
+
+    uchar streamingRed[ColorModel::PROFILE_COUNT][256];
+    uchar streamingGreen[ColorModel::PROFILE_COUNT][256];
+    uchar streamingBlue[ColorModel::PROFILE_COUNT][256];
+};
+
+static const CorrectionTables tables;
+
+// Set from the GUI thread, and read by encoders on worker threads
+static QAtomicInt currentProfile(ColorModel::PROFILE_BLINKYTAPE);
+
+void ColorModel::setProfile(Profile profile)
+{
+    if(profile < 0 || profile >= PROFILE_COUNT) {
+        return;
+    }
+
+    currentProfile.store(profile);
+}
+
+ColorModel::Profile ColorModel::getProfile()
+{
+    return static_cast<Profile>(currentProfile.load());
+}
+
+QString ColorModel::getProfileName(Profile profile)
+{
+    switch(profile) {
+    case PROFILE_BLINKYTAPE:
+        return "BlinkyTape";
+    case PROFILE_GAMMA_2_2:
+        return "Gamma 2.2";
+    case PROFILE_LINEAR:
+        return "Linear";
+    default:
+        return "Unknown";
+    }
+}
+
+QRgb ColorModel::correctBrightness(QRgb uncorrected, Profile profile)
 {
     return qRgb(
-        int(255*pow(qRed(  uncorrected)/255.0, 1.8)),
-        int(255*pow(qGreen(uncorrected)/255.0, 1.8)),
-        int(255*pow(qBlue( uncorrected)/255.0, 2.1))
+        tables.red[profile][qRed(uncorrected)],
+        tables.green[profile][qGreen(uncorrected)],
+        tables.blue[profile][qBlue(uncorrected)]
         );
 }
+
+void ColorModel::correctBrightness(const uchar* colors, int count, uchar* output,
+                                   Profile profile, bool streaming)
+{
+    const uchar* red   = streaming ? tables.streamingRed[profile]   : tables.red[profile];
+    const uchar* green = streaming ? tables.streamingGreen[profile] : tables.green[profile];
+    const uchar* blue  = streaming ? tables.streamingBlue[profile]  : tables.blue[profile];
+
+    for(int i = 0; i < count; i++) {
+        *output++ = red[*colors++];
+        *output++ = green[*colors++];
+        *output++ = blue[*colors++];
+    }
+}
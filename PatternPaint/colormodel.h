@@ -2,15 +2,48 @@
 #define COLORMODEL_H
 
 #include <QColor>
+#include <QString>
 
 class ColorModel
 {
 public:
+    /// Gamma correction profiles for different types of LED hardware
+    enum Profile {
+        PROFILE_BLINKYTAPE = 0,     /// WS2811 LEDs on a BlinkyTape (1.8, 1.8, 2.1)
+        PROFILE_GAMMA_2_2  = 1,     /// Generic LEDs, gamma 2.2 on all channels
+        PROFILE_LINEAR     = 2,     /// No correction
+        PROFILE_COUNT      = 3,
+    };
+
+    /// Select the gamma profile that new patterns and previews should use.
+    /// This can be called while patterns are being encoded, since encoders
+    /// take a copy of the profile when they start (see getProfile()).
+    static void setProfile(Profile profile);
+
+    /// Get the gamma profile currently in use. Work that runs on another
+    /// thread should read this once, and pass the result to the correction
+    /// functions, so that it uses the same profile throughout.
+    static Profile getProfile();
+
+    /// Get a human-readable name for a gamma profile
+    static QString getProfileName(Profile profile);
+
     /// Perform a rough brightness correction (from screen space to LED space)
     /// on a given color value. Note that it drops the alpha channel.
     /// @param uncorrected 32-bit RGB color value in screen space
+    /// @param profile Gamma profile to correct with
     /// @return 32-bit RGB color value converted to LED space
-    static QRgb correctBrightness(QRgb uncorrected);
+    static QRgb correctBrightness(QRgb uncorrected, Profile profile);
+
+    /// Perform a brightness correction on an array of packed 24-bit RGB colors
+    /// @param colors Packed RGB24 color data in screen space, count*3 bytes
+    /// @param count Number of colors in the array
+    /// @param output Output buffer, must have space for count*3 bytes
+    /// @param profile Gamma profile to correct with
+    /// @param streaming If true, limit the output values to 254, since 255 is
+    /// reserved as the frame marker when streaming to a BlinkyTape
+    static void correctBrightness(const uchar* colors, int count, uchar* output,
+                                  Profile profile, bool streaming = false);
 };
 
 #endif // COLORMODEL_H
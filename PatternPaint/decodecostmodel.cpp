@@ -0,0 +1,145 @@
+#include "decodecostmodel.h"
+
+#include <QDebug>
+
+/// Clock speed of the ATmega32U4, in cycles per microsecond
+#define CPU_CYCLES_PER_US       16
+
+/// Time for FastLED to send one LED's color to a WS2811 (24 bits at 800 kHz),
+/// and the latch time it waits for at the end of each frame, in microseconds
+#define LED_OUTPUT_TIME_US      30
+#define LED_LATCH_TIME_US       50
+
+/// Cycles spent in the sketch's main loop for each frame, outside of the
+/// decoder (checking for serial data and the button)
+#define LOOP_OVERHEAD_CYCLES    300
+
+/// The player waits frameDelay ms after each frame, so it always runs a little
+/// slow. Patterns are still accepted for it as long as the frame time doesn't
+/// stretch each frame by more than this, as a percentage of the frame delay.
+#define DELAY_AFTER_MAX_SLOWDOWN_PERCENT    50
+
+/// Cycle costs of each step of a decoder
+struct DecoderCost {
+    int frame;      ///< Once per frame
+    int led;        ///< For every LED in the strip, whether it is written or not
+    int run;        ///< For every run
+    int pixel;      ///< For every LED written
+    int lookup;     ///< For every color table lookup
+    int byte;       ///< For every byte read from flash
+};
+
+/// Decoder costs, by encoding. Reading a byte from flash (LPM plus the
+/// pointer update) is about 5 cycles; storing a pixel into the LED array is
+/// about 10-14 including the loop.
+static const DecoderCost decoderCosts[] = {
+    //frame  led  run  pixel  lookup  byte
+    {  40,    0,   0,   14,     0,     5 },   // RGB24
+    {  40,    0,  40,   12,     0,     5 },   // RGB565_RLE
+    {  40,    0,   0,   10,    24,     5 },   // INDEXED
+    {  40,    0,  20,   12,    24,     5 },   // INDEXED_RLE
+};
+
+static const int decoderCostCount = sizeof(decoderCosts)/sizeof(decoderCosts[0]);
+
+DecodeCostModel::DecodeCostModel(const Pattern& pattern) :
+    frameDelay(pattern.frameDelay),
+    worstTime(0),
+    totalTime(0),
+    frameCount(0)
+{
+    if(pattern.encoding >= decoderCostCount) {
+        errorString = QString("No decode cost known for encoding %1.").arg(pattern.encoding);
+        return;
+    }
+
+    PatternDecoder decoder(pattern);
+    while(decoder.nextFrame()) {
+        int time = frameTime(pattern.encoding, pattern.ledCount, decoder.frameWork());
+
+        worstTime = qMax(worstTime, time);
+        totalTime += time;
+        frameCount++;
+    }
+
+    if(!decoder.isValid()) {
+        errorString = decoder.getErrorString();
+    }
+}
+
+bool DecodeCostModel::isValid() const
+{
+    return errorString.isEmpty();
+}
+
+QString DecodeCostModel::getErrorString() const
+{
+    return errorString;
+}
+
+int DecodeCostModel::worstFrameTime() const
+{
+    return worstTime;
+}
+
+int DecodeCostModel::averageFrameTime() const
+{
+    if(frameCount == 0) {
+        return 0;
+    }
+
+    return totalTime/frameCount;
+}
+
+float DecodeCostModel::maxFrameRate() const
+{
+    if(worstTime == 0) {
+        return 0;
+    }
+
+    return 1000000.0/worstTime;
+}
+
+float DecodeCostModel::achievableFrameRate() const
+{
+    if(frameDelay <= 0) {
+        return maxFrameRate();
+    }
+
+    return 1000000.0/(worstTime + frameDelay*1000);
+}
+
+bool DecodeCostModel::meetsFrameDelay() const
+{
+    // A pattern without a frame delay is played as fast as it can be
+    if(!isValid() || frameDelay <= 0) {
+        return isValid();
+    }
+
+    // The real frame period is the frame time plus the frame delay, so only
+    // reject patterns that would play much slower than asked for.
+    return worstTime*100 <= frameDelay*1000*DELAY_AFTER_MAX_SLOWDOWN_PERCENT;
+}
+
+int DecodeCostModel::frameTime(Pattern::Encoding encoding, int ledCount,
+                               const PatternDecoder::FrameWork& work)
+{
+    if(encoding >= decoderCostCount) {
+        qCritical() << "No decode cost known for encoding:" << encoding;
+        return 0;
+    }
+
+    const DecoderCost& cost = decoderCosts[encoding];
+
+    int cycles = LOOP_OVERHEAD_CYCLES
+            + cost.frame
+            + cost.led*ledCount
+            + cost.run*work.runs
+            + cost.pixel*work.pixels
+            + cost.lookup*work.lookups
+            + cost.byte*work.bytesRead;
+
+    int outputTime = LED_OUTPUT_TIME_US*ledCount + LED_LATCH_TIME_US;
+
+    return (cycles + CPU_CYCLES_PER_US - 1)/CPU_CYCLES_PER_US + outputTime;
+}
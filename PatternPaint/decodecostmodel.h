@@ -0,0 +1,70 @@
+#ifndef DECODECOSTMODEL_H
+#define DECODECOSTMODEL_H
+
+#include <QString>
+#include "pattern.h"
+#include "patterndecoder.h"
+
+/// Estimate how long the PatternPlayer sketch needs to show each frame of a
+/// pattern on the BlinkyTape's 16 MHz ATmega32U4.
+///
+/// Each frame is decoded on the host, counting the steps that the sketch's
+/// decoder takes (bytes read from flash, runs, LEDs written and color table
+/// lookups). Each step is given a cycle cost for the encoding's decoder. The
+/// time to send the frame out to the LEDs is added on top.
+///
+/// The costs are estimates from the instruction counts of the decoder loops,
+/// and are meant to be a little pessimistic. If a pattern passes the check
+/// here, the device should be able to keep up with its frame delay.
+///
+/// The player waits frameDelay ms after showing each frame, so the frame time
+/// is added to the frame delay.
+class DecodeCostModel
+{
+public:
+    /// Estimate the time needed to show each frame of a pattern
+    /// @param pattern Pattern to check
+    explicit DecodeCostModel(const Pattern& pattern);
+
+    /// True if the pattern could be decoded
+    bool isValid() const;
+
+    /// Get a string describing the last error, if any.
+    QString getErrorString() const;
+
+    /// Time needed to decode and show the slowest frame, in microseconds
+    int worstFrameTime() const;
+
+    /// Average time needed to decode and show a frame, in microseconds
+    int averageFrameTime() const;
+
+    /// Fastest frame rate that every frame of the pattern can be shown at
+    float maxFrameRate() const;
+
+    /// Frame rate that the pattern will play at on the device, with the frame
+    /// time added to the frame delay
+    float achievableFrameRate() const;
+
+    /// True if the real frame period (the frame time plus the frame delay)
+    /// isn't much longer than the frame delay, or if the pattern has no frame
+    /// delay
+    bool meetsFrameDelay() const;
+
+    /// Estimate the time needed to show a single frame
+    /// @param encoding Encoding of the pattern
+    /// @param ledCount Number of LEDs in the frame
+    /// @param work Work needed to decode the frame
+    /// @return Time to decode and show the frame, in microseconds
+    static int frameTime(Pattern::Encoding encoding, int ledCount,
+                         const PatternDecoder::FrameWork& work);
+
+private:
+    int frameDelay;         ///< Frame delay of the pattern, in ms
+    int worstTime;          ///< Time for the slowest frame, in microseconds
+    qint64 totalTime;       ///< Time for all frames, in microseconds
+    int frameCount;         ///< Number of frames that were checked
+
+    QString errorString;
+};
+
+#endif // DECODECOSTMODEL_H
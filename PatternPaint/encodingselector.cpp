@@ -0,0 +1,155 @@
+#include "encodingselector.h"
+
+#include <QtConcurrent>
+#include <QDebug>
+
+/// Functor to run a single encoding on a worker thread
+struct EncodePattern {
+    EncodePattern(const FrameStore& frames, int frameDelay, ColorModel::Profile profile) :
+        frames(frames),
+        frameDelay(frameDelay),
+        profile(profile) {}
+
+    typedef EncodingSelector::Candidate result_type;
+
+    EncodingSelector::Candidate operator()(const Pattern::Encoding& encoding) const {
+        return EncodingSelector::Candidate(Pattern(frames, frameDelay, encoding, profile), frames);
+    }
+
+    FrameStore frames;
+    int frameDelay;
+    ColorModel::Profile profile;
+};
+
+EncodingSelector::EncodingSelector(QObject *parent) :
+    QObject(parent),
+    selected(-1),
+    maxSize(0)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(handleEncodingFinished()));
+}
+
+bool EncodingSelector::start(const FrameStore& frames, int frameDelay,
+                             QList<Pattern::Encoding> encodings, int maxSize)
+{
+    if(isRunning()) {
+        errorString = "Already encoding a pattern";
+        return false;
+    }
+
+    if(encodings.length() == 0) {
+        errorString = "No encodings to try";
+        return false;
+    }
+
+    candidates.clear();
+    selected = -1;
+    this->maxSize = maxSize;
+
+    // Every candidate uses the profile that was selected when the encoding
+    // started, even if it is changed while they are running.
+    watcher.setFuture(QtConcurrent::mapped(encodings, EncodePattern(frames, frameDelay,
+                                                                    ColorModel::getProfile())));
+    return true;
+}
+
+bool EncodingSelector::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+Pattern EncodingSelector::getPattern() const
+{
+    return candidates.at(selected).pattern;
+}
+
+DecodeCostModel EncodingSelector::getCost() const
+{
+    return candidates.at(selected).cost;
+}
+
+QString EncodingSelector::getErrorString() const
+{
+    return errorString;
+}
+
+void EncodingSelector::handleEncodingFinished()
+{
+    candidates = watcher.future().results();
+
+    // Fastest frame rate of any result that fits, in case none are fast enough
+    float fastestRate = -1;
+
+    for(int i = 0; i < candidates.length(); i++) {
+        const Pattern& pattern = candidates.at(i).pattern;
+        const DecodeCostModel& cost = candidates.at(i).cost;
+
+        if(!pattern.valid || pattern.data.length() > maxSize) {
+            continue;
+        }
+
+        // Never upload a pattern that the player would show differently
+        if(!candidates.at(i).decodes) {
+            qCritical() << "Encoding" << pattern.encoding
+                        << "doesn't decode back to the pattern, skipping it";
+            continue;
+        }
+
+        fastestRate = qMax(fastestRate, cost.maxFrameRate());
+
+        if(!cost.meetsFrameDelay()) {
+            continue;
+        }
+
+        // Prefer any lossless encoding over a lossy one, then the smallest
+        if(selected >= 0) {
+            const Pattern& best = candidates.at(selected).pattern;
+            if(best.lossless && !pattern.lossless) {
+                continue;
+            }
+            if(best.lossless == pattern.lossless
+                    && pattern.data.length() >= best.data.length()) {
+                continue;
+            }
+        }
+
+        selected = i;
+    }
+
+    if(selected < 0 && fastestRate >= 0) {
+        errorString = QString("Sorry! The Pattern is too fast for the BlinkyTape to play. Requested speed=%1 fps, fastest possible=%2 fps")
+                .arg(1000.0/candidates.first().pattern.frameDelay, 0, 'f', 1)
+                .arg(fastestRate, 0, 'f', 1);
+        emit(finished(false));
+        return;
+    }
+
+    if(selected < 0) {
+        int smallestSize = -1;
+        for(int i = 0; i < candidates.length(); i++) {
+            if(!candidates.at(i).pattern.valid) {
+                continue;
+            }
+
+            int size = candidates.at(i).pattern.data.length();
+            if(smallestSize < 0 || size < smallestSize) {
+                smallestSize = size;
+            }
+        }
+
+        errorString = QString("Sorry! The Pattern is a bit too big to fit in BlinkyTape memory! Avaiable space=%1, Pattern size=%2")
+                .arg(maxSize)
+                .arg(smallestSize);
+        emit(finished(false));
+        return;
+    }
+
+    // The encoders don't log anything themselves, since they run on worker
+    // threads; this is the one line that describes the result.
+    qDebug() << "Selected encoding:" << candidates.at(selected).pattern.encoding
+             << "of" << candidates.length() << "candidates,"
+             << "size:" << candidates.at(selected).pattern.data.length()
+             << "lossless:" << candidates.at(selected).pattern.lossless
+             << "frame rate:" << candidates.at(selected).cost.achievableFrameRate();
+    emit(finished(true));
+}
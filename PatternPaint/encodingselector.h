@@ -0,0 +1,79 @@
+#ifndef ENCODINGSELECTOR_H
+#define ENCODINGSELECTOR_H
+
+#include <QObject>
+#include <QList>
+#include <QFutureWatcher>
+#include "pattern.h"
+#include "decodecostmodel.h"
+#include "patterndecoder.h"
+
+/// Compress a pattern using several encodings at once, and choose the best one.
+/// Each candidate encoding is run on a worker thread, so that large patterns
+/// don't stall the GUI. Once all of them are finished, the smallest lossless
+/// result that fits into the available space is chosen. If none of the lossless
+/// results fit, the smallest lossy result that fits is used instead.
+/// Results that the device would play much slower than the frame delay asks
+/// for (see DecodeCostModel), or that don't decode back to the pattern (see
+/// PatternDecoder::matches()), are never chosen.
+class EncodingSelector : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EncodingSelector(QObject *parent = 0);
+
+    /// Start encoding a pattern in the background. The finished() signal is sent
+    /// once an encoding has been selected.
+    /// @param frames Frames to encode
+    /// @param frameDelay Length of time between frames of data, in ms
+    /// @param encodings List of encodings to try
+    /// @param maxSize Maximum size of the encoded pattern data, in bytes
+    /// @return true if the encoding was started
+    bool start(const FrameStore& frames, int frameDelay,
+               QList<Pattern::Encoding> encodings, int maxSize);
+
+    /// True if an encoding is currently underway
+    bool isRunning() const;
+
+    /// Get the selected pattern. Only valid after finished(true) was sent.
+    Pattern getPattern() const;
+
+    /// Get the playback speed of the selected pattern. Only valid after
+    /// finished(true) was sent.
+    DecodeCostModel getCost() const;
+
+    /// Result of encoding the pattern with one of the candidate encodings
+    struct Candidate {
+        Candidate(const Pattern& pattern, const FrameStore& source) :
+            pattern(pattern),
+            cost(pattern),
+            decodes(PatternDecoder(pattern).matches(source)) {}
+
+        Pattern pattern;
+        DecodeCostModel cost;   ///< How fast the device can play the pattern
+        bool decodes;           ///< True if the pattern decodes back to the frames it was made from
+    };
+
+    /// Get a string describing the last error, if any.
+    QString getErrorString() const;
+
+signals:
+    /// Sent when all encodings are complete
+    /// @param result true if a suitable encoding was found
+    void finished(bool result);
+
+private slots:
+    void handleEncodingFinished();
+
+private:
+    QFutureWatcher<Candidate> watcher;
+
+    QList<Candidate> candidates;    ///< Results from the last encoding run
+    int selected;               ///< Index of the selected pattern
+    int maxSize;                ///< Maximum size of the encoded pattern data
+
+    QString errorString;
+};
+
+#endif // ENCODINGSELECTOR_H
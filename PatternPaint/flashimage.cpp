@@ -0,0 +1,245 @@
+#include "flashimage.h"
+
+FlashImage::FlashImage(int size, int pageSize) :
+    flashSize(size),
+    flashPageSize(pageSize)
+{
+}
+
+bool FlashImage::checkPlacement(const QString& name, int address, int length, int ignore)
+{
+    if(address < 0 || address + length > flashSize) {
+        errorString = QString("Section %1 (%2 bytes at 0x%3) doesn't fit in the flash, which is %4 bytes long.")
+                .arg(name)
+                .arg(length)
+                .arg(address, 4, 16, QChar('0'))
+                .arg(flashSize);
+        return false;
+    }
+
+    for(int index = 0; index < sections.length(); index++) {
+        const Section& section = sections.at(index);
+        if(index == ignore) {
+            continue;
+        }
+
+        if(address < section.end() && section.address < address + length) {
+            errorString = QString("Section %1 (%2 bytes at 0x%3) overlaps section %4 (%5 bytes at 0x%6).")
+                    .arg(name)
+                    .arg(length)
+                    .arg(address, 4, 16, QChar('0'))
+                    .arg(section.name)
+                    .arg(section.data.length())
+                    .arg(section.address, 4, 16, QChar('0'));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void FlashImage::insertSection(const Section& section)
+{
+    int index = 0;
+    while(index < sections.length() && sections.at(index).address < section.address) {
+        index++;
+    }
+
+    sections.insert(index, section);
+}
+
+bool FlashImage::addSection(const QString& name, int address, const QByteArray& data)
+{
+    if(address % flashPageSize != 0) {
+        errorString = QString("Section %1 must start on a page boundary, but starts at 0x%2.")
+                .arg(name)
+                .arg(address, 4, 16, QChar('0'));
+        return false;
+    }
+
+    if(!checkPlacement(name, address, data.length())) {
+        return false;
+    }
+
+    insertSection(Section(name, address, data));
+    return true;
+}
+
+int FlashImage::allocateSection(const QString& name, const QByteArray& data, int alignment)
+{
+    if(alignment <= 0) {
+        alignment = flashPageSize;
+    }
+
+    // Find the smallest gap between sections that the data fits in, so that
+    // the large gaps are kept for large sections.
+    int bestAddress = -1;
+    int bestGapLength = 0;
+
+    int gapStart = 0;
+    for(int index = 0; index <= sections.length(); index++) {
+        int gapEnd = (index < sections.length()) ? sections.at(index).address : flashSize;
+
+        int address = gapStart;
+        if(address % alignment != 0) {
+            address += alignment - address % alignment;
+        }
+
+        if(address + data.length() <= gapEnd
+                && (bestAddress < 0 || gapEnd - gapStart < bestGapLength)) {
+            bestAddress = address;
+            bestGapLength = gapEnd - gapStart;
+        }
+
+        if(index < sections.length()) {
+            gapStart = sections.at(index).end();
+        }
+    }
+
+    if(bestAddress < 0) {
+        errorString = QString("Not enough space in the flash for section %1 (%2 bytes, %3 bytes free).")
+                .arg(name)
+                .arg(data.length())
+                .arg(freeSpace());
+        return -1;
+    }
+
+    insertSection(Section(name, bestAddress, data));
+    return bestAddress;
+}
+
+bool FlashImage::updateSection(const QString& name, const QByteArray& data)
+{
+    for(int index = 0; index < sections.length(); index++) {
+        if(sections.at(index).name != name) {
+            continue;
+        }
+
+        if(!checkPlacement(name, sections.at(index).address, data.length(), index)) {
+            return false;
+        }
+
+        sections[index].data = data;
+        return true;
+    }
+
+    errorString = QString("No section named %1.").arg(name);
+    return false;
+}
+
+const QList<FlashImage::Section>& FlashImage::getSections() const
+{
+    return sections;
+}
+
+const FlashImage::Section* FlashImage::findSection(const QString& name) const
+{
+    for(int index = 0; index < sections.length(); index++) {
+        if(sections.at(index).name == name) {
+            return &sections.at(index);
+        }
+    }
+
+    return 0;
+}
+
+int FlashImage::size() const
+{
+    return flashSize;
+}
+
+int FlashImage::pageSize() const
+{
+    return flashPageSize;
+}
+
+int FlashImage::freeSpace() const
+{
+    int used = 0;
+    foreach(const Section& section, sections) {
+        used += section.data.length();
+    }
+
+    return flashSize - used;
+}
+
+int FlashImage::largestFreeSpace() const
+{
+    int largest = 0;
+
+    int gapStart = 0;
+    for(int index = 0; index <= sections.length(); index++) {
+        int gapEnd = (index < sections.length()) ? sections.at(index).address : flashSize;
+        largest = qMax(largest, gapEnd - gapStart);
+
+        if(index < sections.length()) {
+            gapStart = sections.at(index).end();
+        }
+    }
+
+    return largest;
+}
+
+QByteArray FlashImage::toByteArray() const
+{
+    if(sections.isEmpty()) {
+        return QByteArray();
+    }
+
+    int length = sections.last().end();
+    if(length % flashPageSize != 0) {
+        length += flashPageSize - length % flashPageSize;
+    }
+
+    QByteArray image(length, static_cast<char>(0xFF));
+    foreach(const Section& section, sections) {
+        image.replace(section.address, section.data.length(), section.data);
+    }
+
+    return image;
+}
+
+QMap<int, QByteArray> FlashImage::getDirtyPages() const
+{
+    QMap<int, QByteArray> pages;
+
+    QByteArray image = toByteArray();
+    foreach(const Section& section, sections) {
+        int firstPage = section.address - section.address % flashPageSize;
+
+        for(int page = firstPage; page < section.end(); page += flashPageSize) {
+            if(!pages.contains(page)) {
+                pages.insert(page, image.mid(page, flashPageSize));
+            }
+        }
+    }
+
+    return pages;
+}
+
+QList<FlashSection> FlashImage::getDirtyRuns() const
+{
+    return mergePages(getDirtyPages());
+}
+
+QList<FlashSection> FlashImage::mergePages(const QMap<int, QByteArray>& pages)
+{
+    QList<FlashSection> runs;
+
+    for(QMap<int, QByteArray>::const_iterator page = pages.constBegin();
+        page != pages.constEnd(); ++page) {
+        if(!runs.isEmpty() && runs.last().address + runs.last().data.length() == page.key()) {
+            runs.last().data.append(page.value());
+        }
+        else {
+            runs.append(FlashSection(page.key(), page.value()));
+        }
+    }
+
+    return runs;
+}
+
+QString FlashImage::getErrorString() const
+{
+    return errorString;
+}
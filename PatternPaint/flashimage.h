@@ -0,0 +1,141 @@
+#ifndef FLASHIMAGE_H
+#define FLASHIMAGE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include "blinkytape.h"
+
+/// A block of memory to write to the flash
+struct FlashSection {
+    FlashSection(int address,
+                 QByteArray data) :
+        address(address),
+        data(data) {}
+
+    int address;
+    QByteArray data;
+};
+
+/// Memory image of the device flash, built up from named sections.
+///
+/// Sections are either placed at a fixed address (the sketch, the pattern
+/// table), or allocated into the smallest free space that fits (pattern data).
+/// Sections don't need to fill whole pages, so small sections can be packed
+/// into the ends of pages that other sections only partly use.
+/// Every section is checked as it is added, so that one can't overlap another
+/// or fall outside of the flash. A section that grows too large is reported as
+/// an error here, instead of overwriting the section after it on the device.
+///
+/// The finished image can be read back as one contiguous block, or as a sparse
+/// map of the pages that hold any section data. Pages that no section touches
+/// are left alone on the device.
+class FlashImage
+{
+public:
+    /// Named block of data in the image
+    struct Section {
+        Section(const QString& name, int address, const QByteArray& data) :
+            name(name),
+            address(address),
+            data(data) {}
+
+        QString name;       ///< Human-readable name, for error messages
+        int address;        ///< Location of the section in the flash, in bytes
+        QByteArray data;    ///< Contents of the section
+
+        /// Address of the first byte after the section
+        int end() const { return address + data.length(); }
+    };
+
+    /// Create an empty image
+    /// @param size Size of the flash that sections can be placed in, in bytes
+    /// @param pageSize Size of a flash page, in bytes
+    explicit FlashImage(int size = FLASH_MEMORY_AVAILABLE,
+                        int pageSize = FLASH_MEMORY_PAGE_SIZE);
+
+    /// Place a section at a fixed address
+    /// @param name Name of the section
+    /// @param address Location of the section. Must be page aligned.
+    /// @param data Contents of the section
+    /// @return true if the section was placed, false if it was outside of the
+    /// flash or overlapped another section.
+    bool addSection(const QString& name, int address, const QByteArray& data);
+
+    /// Place a section in the smallest free space that it fits in. If several
+    /// are the same size, the lowest one is used. Allocating the largest
+    /// sections first packs them the most tightly.
+    /// @param name Name of the section
+    /// @param data Contents of the section
+    /// @param alignment Alignment of the section's address, in bytes. By
+    /// default, sections start on a page boundary.
+    /// @return Address of the section, or -1 if there was no room for it
+    int allocateSection(const QString& name, const QByteArray& data, int alignment = 0);
+
+    /// Replace the contents of a section, keeping its address. This lets a
+    /// section (such as a table of addresses) be reserved before its contents
+    /// are known.
+    /// @param name Name of the section to update
+    /// @param data New contents of the section
+    /// @return true if the section was updated, false if there is no section
+    /// with that name, or if the new contents don't fit.
+    bool updateSection(const QString& name, const QByteArray& data);
+
+    /// Get the sections in the image, in address order
+    const QList<Section>& getSections() const;
+
+    /// Find a section by name
+    /// @return The section, or 0 if there is no section with that name
+    const Section* findSection(const QString& name) const;
+
+    /// Size of the flash that sections can be placed in, in bytes
+    int size() const;
+
+    /// Size of a flash page, in bytes
+    int pageSize() const;
+
+    /// Number of bytes in the image that are not used by any section
+    int freeSpace() const;
+
+    /// Size of the largest space between sections, which is the largest
+    /// section that allocateSection() can place with an alignment of 1
+    int largestFreeSpace() const;
+
+    /// Get the image as a single block, starting at address 0 and ending with
+    /// the last page that holds any section data. Space between sections is
+    /// filled with 0xFF (erased flash).
+    QByteArray toByteArray() const;
+
+    /// Get the pages that hold section data
+    /// @return Contents of each page, by page address
+    QMap<int, QByteArray> getDirtyPages() const;
+
+    /// Get the pages that hold section data, merged into runs of consecutive
+    /// pages so they can be written with as few commands as possible
+    QList<FlashSection> getDirtyRuns() const;
+
+    /// Merge a map of pages into runs of consecutive pages
+    /// @param pages Contents of each page, by page address
+    static QList<FlashSection> mergePages(const QMap<int, QByteArray>& pages);
+
+    /// Get a string describing the last error, if any.
+    QString getErrorString() const;
+
+private:
+    int flashSize;              ///< Size of the flash, in bytes
+    int flashPageSize;          ///< Size of a flash page, in bytes
+    QList<Section> sections;    ///< Sections in the image, in address order
+
+    QString errorString;
+
+    /// Check that a block of memory is inside the flash and not used by any section
+    /// @param name Name of the section being placed, for error messages
+    /// @param ignore Section to leave out of the overlap check, or -1
+    bool checkPlacement(const QString& name, int address, int length, int ignore = -1);
+
+    /// Add a section that has already been checked, keeping the list in address order
+    void insertSection(const Section& section);
+};
+
+#endif // FLASHIMAGE_H
@@ -0,0 +1,105 @@
+#include "flashrecord.h"
+
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QDebug>
+
+/// Settings group that the records are stored in
+#define FLASH_RECORD_GROUP "FlashRecords"
+
+/// Length of a page hash, in bytes (MD5)
+#define PAGE_HASH_LENGTH 16
+
+/// Length of a stored record entry: page address (2 bytes), then the hash
+#define RECORD_ENTRY_LENGTH (2 + PAGE_HASH_LENGTH)
+
+FlashRecord::FlashRecord(const QString& serialNumber) :
+    serialNumber(serialNumber)
+{
+    if(serialNumber.isEmpty()) {
+        return;
+    }
+
+    QSettings settings;
+    settings.beginGroup(FLASH_RECORD_GROUP);
+    QByteArray stored = settings.value(serialNumber).toByteArray();
+    settings.endGroup();
+
+    if(stored.length() % RECORD_ENTRY_LENGTH != 0) {
+        qCritical() << "Ignoring damaged flash record for device" << serialNumber;
+        return;
+    }
+
+    const uchar* data = reinterpret_cast<const uchar*>(stored.constData());
+    for(int offset = 0; offset < stored.length(); offset += RECORD_ENTRY_LENGTH) {
+        int address = (data[offset] << 8) + data[offset + 1];
+        pageHashes.insert(address, stored.mid(offset + 2, PAGE_HASH_LENGTH));
+    }
+}
+
+bool FlashRecord::isEmpty() const
+{
+    return pageHashes.isEmpty();
+}
+
+QByteArray FlashRecord::hashPage(const QByteArray& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+QMap<int, QByteArray> FlashRecord::getChangedPages(const FlashImage& image) const
+{
+    QMap<int, QByteArray> pages = image.getDirtyPages();
+
+    QMap<int, QByteArray>::iterator page = pages.begin();
+    while(page != pages.end()) {
+        if(pageHashes.value(page.key()) == hashPage(page.value())) {
+            page = pages.erase(page);
+        }
+        else {
+            ++page;
+        }
+    }
+
+    return pages;
+}
+
+void FlashRecord::removePages(const QMap<int, QByteArray>& pages)
+{
+    foreach(int address, pages.keys()) {
+        pageHashes.remove(address);
+    }
+}
+
+void FlashRecord::addPages(const QMap<int, QByteArray>& pages)
+{
+    for(QMap<int, QByteArray>::const_iterator page = pages.constBegin();
+        page != pages.constEnd(); ++page) {
+        pageHashes.insert(page.key(), hashPage(page.value()));
+    }
+}
+
+void FlashRecord::clear()
+{
+    pageHashes.clear();
+}
+
+void FlashRecord::save() const
+{
+    if(serialNumber.isEmpty()) {
+        return;
+    }
+
+    QByteArray stored;
+    for(QMap<int, QByteArray>::const_iterator page = pageHashes.constBegin();
+        page != pageHashes.constEnd(); ++page) {
+        stored.append(static_cast<char>((page.key() >> 8) & 0xFF));
+        stored.append(static_cast<char>((page.key()     ) & 0xFF));
+        stored.append(page.value());
+    }
+
+    QSettings settings;
+    settings.beginGroup(FLASH_RECORD_GROUP);
+    settings.setValue(serialNumber, stored);
+    settings.endGroup();
+}
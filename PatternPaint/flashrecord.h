@@ -0,0 +1,57 @@
+#ifndef FLASHRECORD_H
+#define FLASHRECORD_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+#include "flashimage.h"
+
+/// Record of what was last written to the flash of a device, so that an
+/// upload only needs to write the pages that changed.
+///
+/// Records are kept in the application settings, keyed by the device's USB
+/// serial number, and hold a hash of each page that was written. A page is
+/// dropped from the record before it is written, and only added back once the
+/// upload has finished, so an upload that fails part way through can't leave
+/// a record that claims data the device doesn't have.
+///
+/// Devices without a serial number never have a record, so every page is
+/// written to them.
+class FlashRecord
+{
+public:
+    /// Load the record for a device
+    /// @param serialNumber USB serial number of the device
+    explicit FlashRecord(const QString& serialNumber);
+
+    /// True if nothing is known about the device's flash
+    bool isEmpty() const;
+
+    /// Find the pages of an image that differ from what the device holds
+    /// @param image Image that should be on the device
+    /// @return Contents of each page that needs to be written, by page address
+    QMap<int, QByteArray> getChangedPages(const FlashImage& image) const;
+
+    /// Forget what is in some pages, because they are about to be written
+    /// @param pages Pages to forget, by page address
+    void removePages(const QMap<int, QByteArray>& pages);
+
+    /// Remember what is in some pages, after they were written
+    /// @param pages Contents of each page, by page address
+    void addPages(const QMap<int, QByteArray>& pages);
+
+    /// Forget everything about the device's flash
+    void clear();
+
+    /// Store the record in the application settings
+    void save() const;
+
+private:
+    QString serialNumber;               ///< USB serial number of the device
+    QMap<int, QByteArray> pageHashes;   ///< Hash of each known page, by page address
+
+    /// Hash the contents of a page
+    static QByteArray hashPage(const QByteArray& data);
+};
+
+#endif // FLASHRECORD_H
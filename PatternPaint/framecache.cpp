@@ -0,0 +1,86 @@
+#include "framecache.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+
+/// Frames from the last run of an encoding
+struct CachedRun {
+    QByteArray context;
+    QHash<uint, FrameCache::Entry> frames;
+};
+
+static QMutex cacheMutex;
+static QMap<int, CachedRun> cachedRuns;
+
+FrameCache::FrameCache(int encoding, const QByteArray& context) :
+    encoding(encoding),
+    context(context),
+    hits(0)
+{
+    QMutexLocker locker(&cacheMutex);
+
+    QMap<int, CachedRun>::const_iterator run = cachedRuns.constFind(encoding);
+    if(run != cachedRuns.constEnd() && run.value().context == context) {
+        previous = run.value().frames;
+    }
+}
+
+bool FrameCache::find(uint hash, const QByteArray& source, QByteArray& encoded,
+                      bool& lossless)
+{
+    QHash<uint, Entry>::const_iterator entry = current.constFind(hash);
+    if(entry != current.constEnd() && matches(entry.value(), source)) {
+        encoded = entry.value().encoded;
+        lossless = entry.value().lossless;
+        hits++;
+        return true;
+    }
+
+    entry = previous.constFind(hash);
+    if(entry != previous.constEnd() && matches(entry.value(), source)) {
+        encoded = entry.value().encoded;
+        lossless = entry.value().lossless;
+        current.insert(hash, entry.value());
+        hits++;
+        return true;
+    }
+
+    return false;
+}
+
+void FrameCache::insert(uint hash, const QByteArray& source, const QByteArray& encoded,
+                        bool lossless)
+{
+    Entry entry;
+    entry.sourceHash = qHash(source);
+    entry.sourceLength = source.length();
+    entry.encoded = encoded;
+    entry.lossless = lossless;
+    current.insert(hash, entry);
+}
+
+void FrameCache::save()
+{
+    int size = 0;
+    foreach(const Entry& entry, current) {
+        size += entry.encoded.length();
+    }
+
+    QMutexLocker locker(&cacheMutex);
+
+    if(size > MAX_RUN_SIZE) {
+        cachedRuns.remove(encoding);
+        return;
+    }
+
+    CachedRun& run = cachedRuns[encoding];
+    run.context = context;
+    run.frames = current;
+}
+
+bool FrameCache::matches(const Entry& entry, const QByteArray& source)
+{
+    return entry.sourceLength == source.length()
+            && entry.sourceHash == qHash(source);
+}
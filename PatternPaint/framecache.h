@@ -0,0 +1,78 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <QByteArray>
+#include <QHash>
+
+/// Cache of encoded frames, so that encoding a pattern again after a small
+/// edit only has to encode the frames that changed.
+///
+/// Frames are looked up by their hash (see FrameStore::frameHash()). The source
+/// data isn't kept; instead a second, independent hash of it and its length
+/// have to match as well, so that a collision in one hash can't produce a
+/// wrong frame. Each encoding keeps the frames from its most recent run; a
+/// FrameCache reads them when it is created, and replaces them with the frames
+/// that were used in this run when save() is called. Runs whose encoded frames
+/// add up to more than MAX_RUN_SIZE aren't kept, since a pattern that large
+/// can't be uploaded anyway. The context should hold anything other than the
+/// frame data that changes the output (the color table, the brightness
+/// profile), and the cache is thrown away if it doesn't match.
+///
+/// Each encoder uses its own FrameCache object, so encoders can run on
+/// separate threads.
+class FrameCache
+{
+public:
+    /// Largest run, in bytes of encoded frames, that is kept for the next run
+    static const int MAX_RUN_SIZE = 64*1024;
+
+    /// Load the cached frames for an encoding
+    /// @param encoding Encoding (with any flags) that the frames are encoded with
+    /// @param context Other inputs to the encoder, that must match for cached
+    /// frames to be used
+    FrameCache(int encoding, const QByteArray& context);
+
+    /// Look for an encoded frame. A frame that is found is kept for the next
+    /// run, so it doesn't need to be inserted again.
+    /// @param hash Hash of the source data
+    /// @param source Data the frame was encoded from
+    /// @param encoded Set to the encoded frame, if it was found
+    /// @param lossless Set to true if the encoded frame is lossless, if it was found
+    /// @return true if the frame was found
+    bool find(uint hash, const QByteArray& source, QByteArray& encoded, bool& lossless);
+
+    /// Add an encoded frame to this run
+    /// @param hash Hash of the source data
+    /// @param source Data the frame was encoded from (only its hash is kept)
+    /// @param encoded Encoded frame
+    /// @param lossless True if the encoded frame reproduces the source exactly
+    void insert(uint hash, const QByteArray& source, const QByteArray& encoded,
+                bool lossless);
+
+    /// Store the frames from this run, replacing the previous ones
+    void save();
+
+    /// Number of frames that were found in the cache in this run
+    int hitCount() const { return hits; }
+
+    struct Entry {
+        uint sourceHash;        ///< Second hash of the data the frame was encoded from
+        int sourceLength;       ///< Length of the data the frame was encoded from
+        QByteArray encoded;     ///< Encoded frame
+        bool lossless;          ///< True if the encoded frame is lossless
+    };
+
+private:
+
+    int encoding;
+    QByteArray context;
+
+    QHash<uint, Entry> previous;    ///< Frames from the last run
+    QHash<uint, Entry> current;     ///< Frames used in this run
+    int hits;
+
+    /// Check if a cached frame was encoded from the given source data
+    static bool matches(const Entry& entry, const QByteArray& source);
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,100 @@
+#include "framestore.h"
+
+FrameStore::FrameStore() :
+    frames(0),
+    leds(0)
+{
+}
+
+FrameStore::FrameStore(const QImage& image) :
+    frames(0),
+    leds(0)
+{
+    setImage(image);
+}
+
+FrameStore::FrameStore(int frameCount, int ledCount, const QByteArray& data) :
+    frames(frameCount),
+    leds(ledCount),
+    data(data),
+    hashes(frameCount)
+{
+    updateHashes(0, frameCount - 1);
+}
+
+void FrameStore::setImage(const QImage& image)
+{
+    frames = image.width();
+    leds = image.height();
+    data = QByteArray(frames*leds*3, 0);
+    hashes = QVector<uint>(frames);
+
+    update(image, image.rect());
+}
+
+void FrameStore::update(const QImage& image, const QRect& region)
+{
+    if(image.width() != frames || image.height() != leds) {
+        setImage(image);
+        return;
+    }
+
+    QRect bounded = region.intersected(image.rect());
+    if(bounded.isEmpty()) {
+        return;
+    }
+
+    // Scan lines can be read directly for 32-bit formats; this matches what
+    // QImage::pixel() returns for them.
+    QImage source = image;
+    if(image.format() != QImage::Format_RGB32
+            && image.format() != QImage::Format_ARGB32
+            && image.format() != QImage::Format_ARGB32_Premultiplied) {
+        source = image.convertToFormat(QImage::Format_ARGB32);
+    }
+
+    uchar* output = reinterpret_cast<uchar*>(data.data());
+
+    for(int led = bounded.top(); led <= bounded.bottom(); led++) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(led));
+
+        for(int frame = bounded.left(); frame <= bounded.right(); frame++) {
+            uchar* color = output + (frame*leds + led)*3;
+            color[0] = qRed(line[frame]);
+            color[1] = qGreen(line[frame]);
+            color[2] = qBlue(line[frame]);
+        }
+    }
+
+    updateHashes(bounded.left(), bounded.right());
+}
+
+void FrameStore::updateHashes(int first, int last)
+{
+    // 32-bit FNV-1a over each frame's color data
+    for(int index = first; index <= last; index++) {
+        const uchar* color = frame(index);
+        uint hash = 2166136261u;
+
+        for(int i = 0; i < leds*3; i++) {
+            hash = (hash ^ color[i]) * 16777619u;
+        }
+
+        hashes[index] = hash;
+    }
+}
+
+QImage FrameStore::toImage() const
+{
+    QImage image(frames, leds, QImage::Format_RGB32);
+
+    for(int led = 0; led < leds; led++) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(led));
+
+        for(int frame = 0; frame < frames; frame++) {
+            line[frame] = pixel(frame, led);
+        }
+    }
+
+    return image;
+}
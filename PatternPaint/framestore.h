@@ -0,0 +1,80 @@
+#ifndef FRAMESTORE_H
+#define FRAMESTORE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+/// Column-major copy of a pattern image.
+/// A pattern image stores each frame as a column, so walking the LEDs of a
+/// frame in a QImage strides across a whole scan line per LED. The frame store
+/// keeps each frame as a contiguous block of packed RGB24 data instead, so that
+/// encoders and playback can read a frame with a sequential memory scan.
+///
+/// The data is implicitly shared, so copying a frame store to hand it to a
+/// worker thread is cheap.
+///
+/// A hash of each frame is kept up to date as frames change, so that encoders
+/// can tell which frames are the same as the last time they saw them.
+class FrameStore
+{
+public:
+    FrameStore();
+
+    /// Create a frame store from an image
+    /// @param image Image to copy; each column is a frame, each row is an LED
+    explicit FrameStore(const QImage& image);
+
+    /// Create a frame store from packed frame data
+    /// @param frameCount Number of frames in the data
+    /// @param ledCount Number of LEDs in each frame
+    /// @param data Packed RGB24 data, one frame after another
+    FrameStore(int frameCount, int ledCount, const QByteArray& data);
+
+    /// Replace the contents of the frame store with a new image
+    /// @param image Image to copy; each column is a frame, each row is an LED
+    void setImage(const QImage& image);
+
+    /// Copy a region of an image into the frame store. The image must have the
+    /// same dimensions as the frame store.
+    /// @param image Image to copy from
+    /// @param region Region of the image that changed
+    void update(const QImage& image, const QRect& region);
+
+    /// Convert the frame store back into an RGB32 image
+    QImage toImage() const;
+
+    int frameCount() const { return frames; }
+    int ledCount() const { return leds; }
+
+    /// Get the packed RGB24 data for all frames
+    const QByteArray& frameData() const { return data; }
+
+    /// Get the color data for a single frame
+    /// @param index Frame to read
+    /// @return Packed RGB24 data for the frame, ledCount()*3 bytes long
+    const uchar* frame(int index) const {
+        return reinterpret_cast<const uchar*>(data.constData()) + index*leds*3;
+    }
+
+    /// Get the hash of a single frame's color data
+    uint frameHash(int index) const { return hashes[index]; }
+
+    /// Get the color of a single LED in a frame
+    QRgb pixel(int frame, int led) const {
+        const uchar* color = this->frame(frame) + led*3;
+        return qRgb(color[0], color[1], color[2]);
+    }
+
+private:
+    int frames;         ///< Number of frames in the pattern
+    int leds;           ///< Number of LEDs in each frame
+    QByteArray data;    ///< Packed RGB24 data, one frame after another
+    QVector<uint> hashes;   ///< Hash of each frame
+
+    /// Recompute the hashes for a range of frames
+    void updateHashes(int first, int last);
+};
+
+#endif // FRAMESTORE_H
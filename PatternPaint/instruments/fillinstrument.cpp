@@ -64,6 +64,7 @@ void FillInstrument::paint(PatternEditor& pe)
 
     if(switchColor != oldColor) {
         fill(mStartPoint, switchColor.rgb(), pixel, pe.getPattern());
+        pe.markModified(pe.getPattern()->rect());
         /*fillRecurs(mStartPoint.x(), mStartPoint.y(),
                    switchColor.rgb(), pixel,
                    *pe.getPattern());
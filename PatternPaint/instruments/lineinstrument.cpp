@@ -49,8 +49,8 @@ void LineInstrument::mousePressEvent(QMouseEvent *event, PatternEditor& pe, cons
 void LineInstrument::mouseMoveEvent(QMouseEvent*, PatternEditor& pe, const QPoint& pt)
 {
     if(pe.isPaint()) {
+        restore(pe);
         mEndPoint = pt;
-        pe.setImage(mImageCopy);
         paint(pe);
     }
 }
@@ -59,7 +59,7 @@ void LineInstrument::mouseReleaseEvent(QMouseEvent *event, PatternEditor& pe, co
 {
     if(pe.isPaint())
     {
-        pe.setImage(mImageCopy);
+        restore(pe);
         if(event->button() == Qt::LeftButton)  paint(pe);
         pe.setPaint(false);
     }
@@ -80,4 +80,26 @@ void LineInstrument::paint(PatternEditor& pe)
     }
 
     painter.end();
+
+    pe.markModified(lineRect(pe));
+}
+
+void LineInstrument::restore(PatternEditor& pe)
+{
+    // Only the area under the last line needs to be put back, so that the
+    // frame store doesn't have to re-read the whole pattern on every move.
+    QRect region = lineRect(pe).intersected(mImageCopy.rect());
+
+    QPainter painter(pe.getPattern());
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(region, mImageCopy, region);
+    painter.end();
+
+    pe.markModified(region);
+}
+
+QRect LineInstrument::lineRect(const PatternEditor& pe) const
+{
+    return QRect(mStartPoint, mEndPoint).normalized()
+            .adjusted(-pe.getPenSize(), -pe.getPenSize(), pe.getPenSize(), pe.getPenSize());
 }
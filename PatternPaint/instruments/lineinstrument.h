@@ -48,6 +48,13 @@ public:
     QCursor cursor() const { return Qt::CrossCursor; }
 protected:
     void paint(PatternEditor&);
+
+private:
+    /// Put back the part of the pattern that the last line was drawn over
+    void restore(PatternEditor&);
+
+    /// Area covered by the line from mStartPoint to mEndPoint
+    QRect lineRect(const PatternEditor&) const;
     
 };
 
@@ -81,4 +81,7 @@ void PencilInstrument::paint(PatternEditor& pe)
     }
 
     painter.end();
+
+    pe.markModified(QRect(mStartPoint, mEndPoint).normalized()
+                    .adjusted(-pe.getPenSize(), -pe.getPenSize(), pe.getPenSize(), pe.getPenSize()));
 }
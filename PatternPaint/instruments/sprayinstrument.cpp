@@ -93,4 +93,8 @@ void SprayInstrument::paint(PatternEditor& pe)
     }
 
     painter.end();
+
+    // Points are scattered at most 8*sqrt(size) away, and are size wide
+    int radius = 8*sqrt(pe.getPenSize()) + pe.getPenSize();
+    pe.markModified(QRect(mEndPoint, mEndPoint).adjusted(-radius, -radius, radius, radius));
 }
@@ -7,6 +7,8 @@
 #include "resizepattern.h"
 #include "undocommand.h"
 #include "colorchooser.h"
+#include "avruploaddata.h"
+#include "patternheaderwriter.h"
 
 
 #include "pencilinstrument.h"
@@ -33,6 +35,33 @@
 
 #define CONNECTION_SCANNER_INTERVAL 100
 
+#define SIZE_METER_INTERVAL 150     // Time to wait after an edit before updating the size estimate
+
+/// Short name for an encoding, for display
+static QString encodingName(Pattern::Encoding encoding) {
+    QString name;
+
+    switch(encoding) {
+    case Pattern::RGB24:
+        name = "RGB24";
+        break;
+    case Pattern::RGB565_RLE:
+        name = "RGB565 RLE";
+        break;
+    case Pattern::INDEXED:
+        name = "Indexed";
+        break;
+    case Pattern::INDEXED_RLE:
+        name = "Indexed RLE";
+        break;
+    default:
+        name = QString::number(encoding);
+        break;
+    }
+
+    return name;
+}
+
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 {
     setupUi(this);
@@ -84,6 +113,18 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     instruments->addWidget(penSizeSpin);
 
 
+    // LED color profiles
+    QMenu* profileMenu = menuTools->addMenu(tr("LED color profile"));
+    QActionGroup* profileGroup = new QActionGroup(this);
+    for(int profile = 0; profile < ColorModel::PROFILE_COUNT; profile++) {
+        QAction* action = profileMenu->addAction(
+                    ColorModel::getProfileName(static_cast<ColorModel::Profile>(profile)));
+        action->setCheckable(true);
+        action->setData(profile);
+        profileGroup->addAction(action);
+    }
+    connect(profileGroup, SIGNAL(triggered(QAction*)), SLOT(on_colorProfileAction(QAction*)));
+
     // tools
     pSpeed = new QSpinBox(this);
     pSpeed->setEnabled(false);
@@ -123,6 +164,15 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 
     connect(penSizeSpin, SIGNAL(valueChanged(int)), patternEditor, SLOT(setToolSize(int)));
 
+    // Encoders run in the background, and report back when an encoding was chosen
+    uploadEncoder = new EncodingSelector(this);
+    connect(uploadEncoder, SIGNAL(finished(bool)),
+            this, SLOT(on_uploadEncoderFinished(bool)));
+
+    exportEncoder = new EncodingSelector(this);
+    connect(exportEncoder, SIGNAL(finished(bool)),
+            this, SLOT(on_exportEncoderFinished(bool)));
+
     // Pre-set the upload progress dialog
     progressDialog = new QProgressDialog(this);
     progressDialog->setWindowTitle("BlinkyTape exporter");
@@ -142,6 +192,20 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     //drawTimer->start(); // why start now?
 
 
+    // Show how much flash the pattern will need, and keep it up to date while painting
+    sizeMeterLabel = new QLabel(this);
+    sizeMeterBar = new QProgressBar(this);
+    sizeMeterBar->setMaximumWidth(150);
+    sizeMeterBar->setTextVisible(false);
+    statusBar()->addPermanentWidget(sizeMeterLabel);
+    statusBar()->addPermanentWidget(sizeMeterBar);
+
+    sizeMeterTimer = new QTimer(this);
+    sizeMeterTimer->setSingleShot(true);
+    sizeMeterTimer->setInterval(SIZE_METER_INTERVAL);
+    connect(sizeMeterTimer, SIGNAL(timeout()), this, SLOT(sizeMeterTimer_timeout()));
+    connect(patternEditor, SIGNAL(modified()), sizeMeterTimer, SLOT(start()));
+
     // Start a scanner to connect to a BlinkyTape automatically
     connect(connectionScannerTimer, SIGNAL(timeout()), this, SLOT(connectionScannerTimer_timeout()));
     connectionScannerTimer->setInterval(CONNECTION_SCANNER_INTERVAL);
@@ -154,6 +218,12 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     actionPen->setChecked(true);
     patternEditor->setInstrument(qvariant_cast<AbstractInstrument*>(actionPen->data()));
     readSettings();
+
+    sizeMeterTimer_timeout();
+
+    foreach(QAction* action, profileGroup->actions()) {
+        action->setChecked(action->data().toInt() == ColorModel::getProfile());
+    }
 }
 
 MainWindow::~MainWindow(){}
@@ -183,21 +253,21 @@ void MainWindow::drawTimer_timeout() {
     lastTime = newTime;
 
 
-    // TODO: Get the width from elsewhere, so we don't need to load the image every frame
-    QImage image = patternEditor->getPatternAsImage();
+    const FrameStore& frames = patternEditor->getFrameStore();
 
     if(tape->isConnected()) {
-        QByteArray ledData;
-
-        for(int i = 0; i < image.height(); i++) {
-            QRgb color = ColorModel::correctBrightness(image.pixel(n, i));
-            ledData.append(qRed(color));
-            ledData.append(qGreen(color));
-            ledData.append(qBlue(color));
+        // The pattern might have been resized since the last frame
+        if(n >= frames.frameCount()) {
+            n = 0;
         }
+
+        QByteArray ledData(frames.ledCount()*3, 0);
+        ColorModel::correctBrightness(frames.frame(n), frames.ledCount(),
+                                      reinterpret_cast<uchar*>(ledData.data()),
+                                      ColorModel::getProfile(), true);
         tape->sendUpdate(ledData);
 
-        n = (n+1)%image.width();
+        n = (n+1)%frames.frameCount();
         patternEditor->setPlaybackRow(n);
     }
 }
@@ -218,6 +288,52 @@ void MainWindow::connectionScannerTimer_timeout() {
     }
 }
 
+void MainWindow::sizeMeterTimer_timeout() {
+    sizeEstimator.update(patternEditor->getFrameStore());
+
+    // The meter shows the smallest encoding that can be uploaded; the tooltip
+    // has the others.
+    int available = avrUploadData::availablePatternSpace();
+    int bestSize = -1;
+    Pattern::Encoding bestEncoding = Pattern::RGB24;
+    QString details = QString("Application space: %1 bytes, available for patterns: %2 bytes\n")
+            .arg(FLASH_MEMORY_AVAILABLE)
+            .arg(available);
+
+    foreach(Pattern::Encoding encoding, Pattern::encodings()) {
+        int size = sizeEstimator.estimate(encoding);
+        if(size < 0) {
+            continue;
+        }
+
+        bool supported = avrUploadData::isEncodingSupported(encoding);
+        details.append(QString("\n%1: %2 bytes%3")
+                       .arg(encodingName(encoding))
+                       .arg(size)
+                       .arg(supported ? "" : " (not supported by the pattern player)"));
+
+        if(supported && (bestSize < 0 || size < bestSize)) {
+            bestSize = size;
+            bestEncoding = encoding;
+        }
+    }
+
+    sizeMeterBar->setRange(0, available);
+    sizeMeterBar->setValue(qMin(qMax(bestSize, 0), available));
+
+    if(bestSize > available) {
+        sizeMeterLabel->setText(QString("Pattern too big: %1 of %2 bytes (%3)")
+                                .arg(bestSize).arg(available).arg(encodingName(bestEncoding)));
+    }
+    else {
+        sizeMeterLabel->setText(QString("Flash: %1 of %2 bytes (%3)")
+                                .arg(bestSize).arg(available).arg(encodingName(bestEncoding)));
+    }
+
+    sizeMeterLabel->setToolTip(details);
+    sizeMeterBar->setToolTip(details);
+}
+
 void MainWindow::on_patternSpeed_valueChanged(int value)
 {
     drawTimer->setInterval(1000/value);
@@ -314,28 +430,53 @@ void MainWindow::on_actionExport_pattern_for_Arduino_triggered()
         return;
     }
 
-    // Convert the current pattern into a Pattern
-    QImage image =  patternEditor->getPatternAsImage();
+    // Only the encodings that the BlinkyTape Arduino library understands
+    QList<Pattern::Encoding> encodings;
+    encodings << Pattern::RGB24 << Pattern::RGB565_RLE
+              << Pattern::INDEXED << Pattern::INDEXED_RLE;
 
     // Note: Converting frameRate to frame delay here.
-    Pattern pattern(image, drawTimer->interval(),
-                        Pattern::INDEXED_RLE);
+    if(!exportEncoder->start(patternEditor->getFrameStore(), drawTimer->interval(),
+                             encodings, FLASH_MEMORY_AVAILABLE)) {
+        QMessageBox::warning(this, tr("Error"), exportEncoder->getErrorString());
+        return;
+    }
+
+    exportFileName = fileName;
+}
+
+void MainWindow::on_exportEncoderFinished(bool result)
+{
+    if(!result) {
+        QMessageBox::warning(this, tr("Error"), exportEncoder->getErrorString());
+        return;
+    }
 
+    Pattern pattern = exportEncoder->getPattern();
+    showFrameRate(exportEncoder->getCost());
 
     // Attempt to open the specified file
-    QFile file(fileName);
+    QFile file(exportFileName);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         QMessageBox::warning(this, tr("Error"), tr("Error, cannot write file %1.")
-                       .arg(fileName));
+                       .arg(exportFileName));
         return;
     }
 
     QTextStream ts(&file);
-    ts << pattern.header;
+    PatternHeaderWriter::write(pattern, ts);
     file.close();
 }
 
 
+void MainWindow::showFrameRate(const DecodeCostModel& cost)
+{
+    statusBar()->showMessage(
+                tr("Pattern plays at %1 fps (slowest frame takes %2 ms on the BlinkyTape)")
+                .arg(cost.achievableFrameRate(), 0, 'f', 1)
+                .arg(cost.worstFrameTime()/1000.0, 0, 'f', 1));
+}
+
 void MainWindow::on_tapeConnectionStatusChanged(bool connected)
 {
     qDebug() << "status changed, connected=" << connected;
@@ -455,6 +596,7 @@ void MainWindow::on_actionLoad_rainbow_sketch_triggered()
     }
     mode = Uploading;
 
+    progressDialog->setLabelText("Saving pattern to BlinkyTape...");
     progressDialog->setValue(progressDialog->minimum());
     progressDialog->show();
 }
@@ -465,30 +607,59 @@ void MainWindow::on_actionSave_to_Tape_triggered()
         return;
     }
 
-    // Convert the current pattern into a Pattern
-    QImage image =  patternEditor->getPatternAsImage();
+    if(uploadEncoder->isRunning() || mode == Uploading) {
+        return;
+    }
+
+    QList<Pattern::Encoding> encodings;
+    foreach(Pattern::Encoding encoding, Pattern::encodings()) {
+        if(avrUploadData::isEncodingSupported(encoding)) {
+            encodings.append(encoding);
+        }
+    }
 
     // Note: Converting frameRate to frame delay here.
-    Pattern pattern(image,
-                        drawTimer->interval(),
-                        Pattern::RGB24);
+    if(!uploadEncoder->start(patternEditor->getFrameStore(), drawTimer->interval(),
+                             encodings, avrUploadData::availablePatternSpace())) {
+        errorMessageDialog->setText(uploadEncoder->getErrorString());
+        errorMessageDialog->show();
+        return;
+    }
 
-    // TODO: Attempt different compressions till one works.
+    progressDialog->setLabelText("Encoding pattern...");
+    progressDialog->setValue(progressDialog->minimum());
+    progressDialog->show();
+}
 
-    qDebug() << "Color count: " << pattern.colorCount();
+void MainWindow::on_uploadEncoderFinished(bool result)
+{
+    if(!result) {
+        progressDialog->hide();
+        errorMessageDialog->setText(uploadEncoder->getErrorString());
+        errorMessageDialog->show();
+        return;
+    }
+
+    // The tape might have gone away while we were encoding
+    if(!(tape->isConnected())) {
+        progressDialog->hide();
+        return;
+    }
 
     std::vector<Pattern> patterns;
-    patterns.push_back(pattern);
+    patterns.push_back(uploadEncoder->getPattern());
+    showFrameRate(uploadEncoder->getCost());
 
     if(!uploader->startUpload(*tape, patterns)) {
+        progressDialog->hide();
         errorMessageDialog->setText(uploader->getErrorString());
         errorMessageDialog->show();
         return;
     }
     mode = Uploading;
 
+    progressDialog->setLabelText("Saving pattern to BlinkyTape...");
     progressDialog->setValue(progressDialog->minimum());
-    progressDialog->show();
 }
 
 
@@ -550,6 +721,10 @@ void MainWindow::writeSettings()
     settings.setValue("size", size());
     settings.setValue("pos", pos());
     settings.endGroup();
+
+    settings.setValue("ColorModel/Profile", ColorModel::getProfile());
+
+    settings.setValue("Upload/Verify", actionVerify_after_upload->isChecked());
 }
 
 void MainWindow::readSettings()
@@ -560,6 +735,12 @@ void MainWindow::readSettings()
     resize(settings.value("size", QSize(880, 450)).toSize());
     move(settings.value("pos", QPoint(100, 100)).toPoint());
     settings.endGroup();
+
+    ColorModel::setProfile(static_cast<ColorModel::Profile>(
+        settings.value("ColorModel/Profile", ColorModel::PROFILE_BLINKYTAPE).toInt()));
+
+    actionVerify_after_upload->setChecked(settings.value("Upload/Verify", true).toBool());
+    uploader->setVerify(actionVerify_after_upload->isChecked());
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
@@ -607,6 +788,11 @@ void MainWindow::on_actionConnect_triggered()
     }
 }
 
+void MainWindow::on_actionVerify_after_upload_toggled(bool checked)
+{
+    uploader->setVerify(checked);
+}
+
 void MainWindow::on_instrumentAction(bool) {
     QAction* act = dynamic_cast<QAction*>(sender());
     Q_ASSERT(act != NULL);
@@ -622,3 +808,10 @@ void MainWindow::on_colorPicked(QColor color) {
     m_colorChooser->setColor(color);
     patternEditor->setToolColor(color);
 }
+
+void MainWindow::on_colorProfileAction(QAction* action) {
+    ColorModel::setProfile(static_cast<ColorModel::Profile>(action->data().toInt()));
+
+    // Brightness correction changes the encoded colors, and so the sizes
+    sizeMeterTimer->start();
+}
@@ -3,6 +3,8 @@
 
 #include <QMainWindow>
 #include <QProgressDialog>
+#include <QProgressBar>
+#include <QLabel>
 #include <QMessageBox>
 
 #include "blinkytape.h"
@@ -10,6 +12,8 @@
 #include "avrpatternuploader.h"
 #include "patterneditor.h"
 #include "addressprogrammer.h"
+#include "encodingselector.h"
+#include "patternsizeestimator.h"
 
 #include "ui_mainwindow.h"
 
@@ -34,6 +38,8 @@ private slots:
 
     void connectionScannerTimer_timeout();
 
+    void sizeMeterTimer_timeout();
+
     void on_actionLoad_File_triggered();
 
     void on_actionSave_File_triggered();
@@ -78,10 +84,18 @@ private slots:
 
     void on_actionConnect_triggered();
 
+    void on_actionVerify_after_upload_toggled(bool checked);
+
     void on_instrumentAction(bool);
 
     void on_colorPicked(QColor);
 
+    void on_colorProfileAction(QAction*);
+
+    void on_uploadEncoderFinished(bool result);
+
+    void on_exportEncoderFinished(bool result);
+
 private:
     ColorChooser* m_colorChooser;
 
@@ -90,8 +104,17 @@ private:
     QPointer<BlinkyTape> tape;
     QPointer<PatternUploader> uploader;
 
+    EncodingSelector* uploadEncoder;  ///< Picks the encoding for patterns sent to the tape
+    EncodingSelector* exportEncoder;  ///< Picks the encoding for exported headers
+    QString exportFileName;           ///< File that the export encoder output is written to
+
     QTimer *connectionScannerTimer;
 
+    PatternSizeEstimator sizeEstimator; ///< Estimates the encoded pattern size while editing
+    QTimer* sizeMeterTimer;             ///< Delays the size estimate until painting pauses
+    QLabel* sizeMeterLabel;             ///< Shows the estimated flash usage
+    QProgressBar* sizeMeterBar;         ///< Shows the estimated flash usage as a fraction of the space available
+
     QProgressDialog* progressDialog;
     QMessageBox* errorMessageDialog;
 
@@ -105,6 +128,10 @@ private:
     QAction* m_redoAction;
 
     QToolButton* createToolButton(QAction *act);
+
+    /// Show the speed that the encoded pattern will play at in the status bar
+    void showFrameRate(const DecodeCostModel& cost);
+
     void writeSettings();
     void readSettings();
 };
@@ -0,0 +1,170 @@
+#include "paletteanalysis.h"
+
+#include <QtConcurrent>
+#include <QThread>
+#include <algorithm>
+
+/// Initial number of slots in a color count table (must be a power of 2)
+#define INITIAL_TABLE_SIZE      256
+
+/// Patterns with fewer LEDs than this (over all frames) are scanned on the calling thread
+#define MIN_THREADED_PIXELS     65536
+
+ColorCountTable::ColorCountTable() :
+    colors(INITIAL_TABLE_SIZE),
+    counts(INITIAL_TABLE_SIZE, 0),
+    used(0),
+    mask(INITIAL_TABLE_SIZE - 1)
+{
+}
+
+static inline int hashColor(QRgb color) {
+    // Fibonacci hashing, to spread nearby colors across the table
+    return (color * 2654435761u) >> 8;
+}
+
+void ColorCountTable::add(QRgb color, int count) {
+    int slot = hashColor(color) & mask;
+
+    while(counts[slot] != 0) {
+        if(colors[slot] == color) {
+            counts[slot] += count;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    colors[slot] = color;
+    counts[slot] = count;
+    used++;
+
+    // Keep the table at most half full, so that probe sequences stay short
+    if(used*2 > mask) {
+        grow();
+    }
+}
+
+void ColorCountTable::merge(const ColorCountTable& other) {
+    for(int slot = 0; slot < other.counts.size(); slot++) {
+        if(other.counts[slot] != 0) {
+            add(other.colors[slot], other.counts[slot]);
+        }
+    }
+}
+
+void ColorCountTable::grow() {
+    QVector<QRgb> oldColors = colors;
+    QVector<int> oldCounts = counts;
+
+    colors = QVector<QRgb>(oldColors.size()*2);
+    counts = QVector<int>(oldCounts.size()*2, 0);
+    mask = colors.size() - 1;
+    used = 0;
+
+    for(int slot = 0; slot < oldCounts.size(); slot++) {
+        if(oldCounts[slot] != 0) {
+            add(oldColors[slot], oldCounts[slot]);
+        }
+    }
+}
+
+
+/// Functor to count the colors in a range of frames from a frame store
+struct ScanFrameStoreRange {
+    ScanFrameStoreRange(const FrameStore& frames) :
+        frames(frames) {}
+
+    typedef ColorCountTable result_type;
+
+    ColorCountTable operator()(const FrameRange& range) const {
+        ColorCountTable table;
+
+        if(range.start == range.end) {
+            return table;
+        }
+
+        // Frames are contiguous, so the whole range is one sequential scan
+        const uchar* color = frames.frame(range.start);
+        const uchar* end = color + (range.end - range.start)*frames.ledCount()*3;
+
+        QRgb runColor = qRgb(color[0], color[1], color[2]);
+        int runCount = 0;
+
+        for(; color < end; color += 3) {
+            QRgb newColor = qRgb(color[0], color[1], color[2]);
+            if(newColor == runColor) {
+                runCount++;
+                continue;
+            }
+
+            table.add(runColor, runCount);
+            runColor = newColor;
+            runCount = 1;
+        }
+
+        table.add(runColor, runCount);
+
+        return table;
+    }
+
+    FrameStore frames;
+};
+
+static void mergeTables(ColorCountTable& result, const ColorCountTable& partial) {
+    result.merge(partial);
+}
+
+PaletteAnalysis::PaletteAnalysis(const FrameStore& frames, bool threaded)
+{
+    if(frames.frameCount() == 0 || frames.ledCount() == 0) {
+        return;
+    }
+
+    QList<FrameRange> ranges = splitFrames(frames.frameCount(), frames.ledCount(), threaded);
+
+    if(ranges.length() == 1) {
+        table = ScanFrameStoreRange(frames)(ranges.front());
+        return;
+    }
+
+    table = QtConcurrent::blockingMappedReduced<ColorCountTable>(
+                ranges, ScanFrameStoreRange(frames), mergeTables);
+}
+
+QList<FrameRange> PaletteAnalysis::splitFrames(int frameCount, int ledCount, bool threaded)
+{
+    int blockCount = 1;
+    if(threaded && frameCount*ledCount >= MIN_THREADED_PIXELS) {
+        blockCount = std::max(1, std::min(QThread::idealThreadCount(), frameCount));
+    }
+
+    QList<FrameRange> ranges;
+    for(int block = 0; block < blockCount; block++) {
+        ranges.append(FrameRange(frameCount*block/blockCount,
+                                 frameCount*(block+1)/blockCount));
+    }
+
+    return ranges;
+}
+
+int PaletteAnalysis::colorCount() const
+{
+    return table.colorCount();
+}
+
+QList<PaletteAnalysis::Entry> PaletteAnalysis::histogram() const
+{
+    QList<Entry> entries;
+    entries.reserve(table.colorCount());
+
+    for(int slot = 0; slot < table.counts.size(); slot++) {
+        if(table.counts[slot] != 0) {
+            Entry entry;
+            entry.color = table.colors[slot];
+            entry.count = table.counts[slot];
+            entries.append(entry);
+        }
+    }
+
+    return entries;
+}
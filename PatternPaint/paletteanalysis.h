@@ -0,0 +1,79 @@
+#ifndef PALETTEANALYSIS_H
+#define PALETTEANALYSIS_H
+
+#include <QList>
+#include <QRgb>
+#include <QVector>
+#include "framestore.h"
+
+/// Open-addressing hash table that counts how many times each color was seen.
+/// An entry with a count of zero is empty, so any QRgb value can be stored.
+class ColorCountTable
+{
+public:
+    ColorCountTable();
+
+    /// Add one or more occurrences of a color to the table
+    /// @param color Color to add
+    /// @param count Number of occurrences to add
+    void add(QRgb color, int count = 1);
+
+    /// Add all of the colors from another table into this one
+    void merge(const ColorCountTable& other);
+
+    /// Number of unique colors in the table
+    int colorCount() const { return used; }
+
+    QVector<QRgb> colors;   ///< Color stored in each slot
+    QVector<int> counts;    ///< Number of occurrences in each slot, or 0 if empty
+
+private:
+    int used;               ///< Number of slots that are in use
+    int mask;               ///< Table size - 1 (table size is a power of 2)
+
+    void grow();
+};
+
+/// Range of frames (image columns) to scan
+struct FrameRange {
+    FrameRange(int start, int end) :
+        start(start),
+        end(end) {}
+
+    int start;
+    int end;
+};
+
+/// Single pass color analysis of a frame store. Counts the unique colors and
+/// builds a histogram, by scanning each frame once. Large patterns are split
+/// into blocks of frames, which are scanned in parallel.
+class PaletteAnalysis
+{
+public:
+    struct Entry {
+        QRgb color;     ///< Color value
+        int count;      ///< Number of pixels that have this color
+    };
+
+    /// Analyze the colors in a frame store
+    /// @param frames Frames to analyze
+    /// @param threaded If true, split the work across worker threads
+    explicit PaletteAnalysis(const FrameStore& frames, bool threaded = true);
+
+    /// Number of unique colors in the frames
+    int colorCount() const;
+
+    /// Histogram of all colors in the frames, in no particular order
+    QList<Entry> histogram() const;
+
+    /// Split a number of frames into blocks to scan on worker threads
+    /// @param frameCount Number of frames
+    /// @param ledCount Number of LEDs in each frame
+    /// @param threaded If false, or the frames are small, return a single block
+    static QList<FrameRange> splitFrames(int frameCount, int ledCount, bool threaded);
+
+private:
+    ColorCountTable table;
+};
+
+#endif // PALETTEANALYSIS_H
@@ -0,0 +1,325 @@
+#include "palettequantizer.h"
+#include "paletteanalysis.h"
+
+#include <QtConcurrent>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+
+QuantizedFrames::QuantizedFrames() :
+    frameCount(0),
+    ledCount(0),
+    lossless(true)
+{
+}
+
+/// A box of colors in the histogram, which can be cut into two smaller boxes
+struct ColorBox {
+    ColorBox(int begin, int end) :
+        begin(begin),
+        end(end) {}
+
+    int begin;      ///< First histogram entry in the box
+    int end;        ///< One past the last histogram entry in the box
+};
+
+static inline int channel(QRgb color, int index) {
+    switch(index) {
+    case 0:
+        return qRed(color);
+    case 1:
+        return qGreen(color);
+    default:
+        return qBlue(color);
+    }
+}
+
+/// Orders histogram entries by one color channel, then by color so that the
+/// order is always the same.
+struct ChannelLess {
+    ChannelLess(int index) :
+        index(index) {}
+
+    bool operator()(const PaletteAnalysis::Entry& a,
+                    const PaletteAnalysis::Entry& b) const {
+        int channelA = channel(a.color, index);
+        int channelB = channel(b.color, index);
+        if(channelA != channelB) {
+            return channelA < channelB;
+        }
+        return a.color < b.color;
+    }
+
+    int index;
+};
+
+static bool colorLess(const PaletteAnalysis::Entry& a,
+                      const PaletteAnalysis::Entry& b) {
+    return a.color < b.color;
+}
+
+/// Find the channel with the widest range in a box
+/// @param range Set to the range of the widest channel
+/// @return Index of the widest channel
+static int widestChannel(const QVector<PaletteAnalysis::Entry>& entries,
+                         const ColorBox& box, int& range) {
+    int low[3] = {255, 255, 255};
+    int high[3] = {0, 0, 0};
+
+    for(int i = box.begin; i < box.end; i++) {
+        for(int c = 0; c < 3; c++) {
+            int value = channel(entries[i].color, c);
+            low[c] = std::min(low[c], value);
+            high[c] = std::max(high[c], value);
+        }
+    }
+
+    int widest = 0;
+    for(int c = 1; c < 3; c++) {
+        if(high[c] - low[c] > high[widest] - low[widest]) {
+            widest = c;
+        }
+    }
+
+    range = high[widest] - low[widest];
+    return widest;
+}
+
+/// Functor to look up the palette index of each LED in a range of frames
+struct MapFrameRange {
+    MapFrameRange(const FrameStore& frames, const QHash<QRgb, uchar>& colorIndexes,
+                  uchar* indexes) :
+        frames(frames),
+        colorIndexes(colorIndexes),
+        indexes(indexes) {}
+
+    void operator()(const FrameRange& range) const {
+        if(range.start == range.end) {
+            return;
+        }
+
+        const uchar* color = frames.frame(range.start);
+        const uchar* end = color + (range.end - range.start)*frames.ledCount()*3;
+        uchar* index = indexes + range.start*frames.ledCount();
+
+        // Runs of the same color are common, so skip the lookup when the color
+        // didn't change.
+        QRgb lastColor = qRgb(color[0], color[1], color[2]);
+        uchar lastIndex = colorIndexes.value(lastColor);
+
+        for(; color < end; color += 3) {
+            QRgb newColor = qRgb(color[0], color[1], color[2]);
+            if(newColor != lastColor) {
+                lastColor = newColor;
+                lastIndex = colorIndexes.value(newColor);
+            }
+            *index++ = lastIndex;
+        }
+    }
+
+    FrameStore frames;
+    QHash<QRgb, uchar> colorIndexes;
+    uchar* indexes;
+};
+
+QuantizedFrames PaletteQuantizer::buildPalette(const FrameStore& frames, int maxColors)
+{
+    QuantizedFrames result;
+    result.frameCount = frames.frameCount();
+    result.ledCount = frames.ledCount();
+
+    QList<PaletteAnalysis::Entry> histogram = PaletteAnalysis(frames).histogram();
+    QVector<PaletteAnalysis::Entry> entries = histogram.toVector();
+
+    // Sort the histogram first, since its order depends on how the scan was
+    // split across threads.
+    std::sort(entries.begin(), entries.end(), colorLess);
+
+    QList<ColorBox> boxes;
+    if(!entries.isEmpty()) {
+        boxes.append(ColorBox(0, entries.size()));
+    }
+
+    // Keep cutting the box with the widest color range in half (by pixel count)
+    // along its widest channel, until there are enough boxes.
+    while(boxes.length() < maxColors) {
+        int cutBox = -1;
+        int cutChannel = 0;
+        int cutRange = 0;
+
+        for(int i = 0; i < boxes.length(); i++) {
+            if(boxes[i].end - boxes[i].begin < 2) {
+                continue;
+            }
+
+            int range;
+            int widest = widestChannel(entries, boxes[i], range);
+            if(range > cutRange) {
+                cutBox = i;
+                cutChannel = widest;
+                cutRange = range;
+            }
+        }
+
+        if(cutBox < 0) {
+            break;
+        }
+
+        ColorBox box = boxes[cutBox];
+        std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                  ChannelLess(cutChannel));
+
+        qint64 total = 0;
+        for(int i = box.begin; i < box.end; i++) {
+            total += entries[i].count;
+        }
+
+        // Split at the median pixel, leaving at least one color on each side
+        int split = box.begin + 1;
+        qint64 count = entries[box.begin].count;
+        while(split < box.end - 1 && count*2 < total) {
+            count += entries[split].count;
+            split++;
+        }
+
+        boxes[cutBox] = ColorBox(box.begin, split);
+        boxes.insert(cutBox + 1, ColorBox(split, box.end));
+    }
+
+    // Each palette color is the average of the colors in its box, weighted by
+    // how often they appear.
+    QHash<QRgb, uchar> colorIndexes;
+    colorIndexes.reserve(entries.size());
+
+    for(int i = 0; i < boxes.length(); i++) {
+        qint64 sum[3] = {0, 0, 0};
+        qint64 total = 0;
+
+        for(int entry = boxes[i].begin; entry < boxes[i].end; entry++) {
+            for(int c = 0; c < 3; c++) {
+                sum[c] += qint64(channel(entries[entry].color, c))*entries[entry].count;
+            }
+            total += entries[entry].count;
+            colorIndexes.insert(entries[entry].color, i);
+        }
+
+        result.palette.append(qRgb(int((sum[0] + total/2)/total),
+                                   int((sum[1] + total/2)/total),
+                                   int((sum[2] + total/2)/total)));
+    }
+
+    result.lossless = (entries.size() <= maxColors);
+
+    // Then map every LED to its palette index
+    result.indexes = QByteArray(frames.frameCount()*frames.ledCount(), 0);
+    if(result.palette.isEmpty()) {
+        return result;
+    }
+
+    QList<FrameRange> ranges = PaletteAnalysis::splitFrames(
+                frames.frameCount(), frames.ledCount(), true);
+    MapFrameRange mapper(frames, colorIndexes,
+                         reinterpret_cast<uchar*>(result.indexes.data()));
+
+    if(ranges.length() == 1) {
+        mapper(ranges.front());
+    }
+    else {
+        QtConcurrent::blockingMap(ranges, mapper);
+    }
+
+    return result;
+}
+
+#define QUANTIZE_CACHE_SIZE 8    // Number of quantized frame sets to keep
+
+/// A quantized set of frames in the cache
+struct QuantizeCacheEntry {
+    uint hash;                  ///< Hash of the frames, to skip comparing the data of most entries
+    int maxColors;              ///< Palette size that was asked for
+    FrameStore frames;          ///< Frames that were quantized
+    QuantizedFrames result;     ///< Quantized frames
+    bool ready;                 ///< False while another thread is still quantizing them
+};
+
+static QMutex cacheMutex;
+static QWaitCondition cacheReady;
+static QList<QuantizeCacheEntry> cacheEntries;  ///< Most recently used first
+
+static uint hashFrames(const FrameStore& frames)
+{
+    // The frame store already has a hash of each frame, so combine those
+    // instead of hashing all of the color data again.
+    uint hash = qHash(frames.ledCount());
+    for(int frame = 0; frame < frames.frameCount(); frame++) {
+        hash = hash*31 + frames.frameHash(frame);
+    }
+    return hash;
+}
+
+static int findCacheEntry(uint hash, const FrameStore& frames, int maxColors)
+{
+    for(int i = 0; i < cacheEntries.length(); i++) {
+        const QuantizeCacheEntry& entry = cacheEntries[i];
+        if(entry.hash == hash
+                && entry.maxColors == maxColors
+                && entry.frames.frameCount() == frames.frameCount()
+                && entry.frames.ledCount() == frames.ledCount()
+                && entry.frames.frameData() == frames.frameData()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QuantizedFrames PaletteQuantizer::quantize(const FrameStore& frames, int maxColors)
+{
+    maxColors = std::max(1, std::min(maxColors, 256));
+    uint hash = hashFrames(frames);
+
+    QMutexLocker locker(&cacheMutex);
+
+    // If another encoder is already quantizing the same frames, wait for its
+    // result instead of repeating the work.
+    int index = findCacheEntry(hash, frames, maxColors);
+    while(index >= 0 && !cacheEntries[index].ready) {
+        cacheReady.wait(&cacheMutex);
+        index = findCacheEntry(hash, frames, maxColors);
+    }
+
+    if(index >= 0) {
+        cacheEntries.move(index, 0);
+        return cacheEntries.first().result;
+    }
+
+    // Reserve an entry so that other callers wait for this one, then quantize
+    // without holding the lock.
+    QuantizeCacheEntry pending;
+    pending.hash = hash;
+    pending.maxColors = maxColors;
+    pending.frames = frames;
+    pending.ready = false;
+    cacheEntries.prepend(pending);
+
+    locker.unlock();
+    QuantizedFrames result = buildPalette(frames, maxColors);
+    locker.relock();
+
+    index = findCacheEntry(hash, frames, maxColors);
+    cacheEntries[index].result = result;
+    cacheEntries[index].ready = true;
+
+    // Drop the least recently used results, keeping any that are still being built
+    for(int i = cacheEntries.length() - 1;
+        i >= 0 && cacheEntries.length() > QUANTIZE_CACHE_SIZE; i--) {
+        if(cacheEntries[i].ready) {
+            cacheEntries.removeAt(i);
+        }
+    }
+
+    cacheReady.wakeAll();
+
+    return result;
+}
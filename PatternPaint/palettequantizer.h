@@ -0,0 +1,53 @@
+#ifndef PALETTEQUANTIZER_H
+#define PALETTEQUANTIZER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QRgb>
+#include "framestore.h"
+
+/// Result of reducing a set of frames to a color palette
+class QuantizedFrames
+{
+public:
+    QuantizedFrames();
+
+    int frameCount;             ///< Number of frames
+    int ledCount;               ///< Number of LEDs in each frame
+    QVector<QRgb> palette;      ///< Palette colors, at most the requested number
+    QByteArray indexes;         ///< Palette index of each LED, one frame after another
+    bool lossless;              ///< True if every color in the frames is in the palette
+
+    /// Get the palette indexes for a single frame
+    /// @param index Frame to read
+    /// @return ledCount bytes of palette indexes
+    const uchar* frame(int index) const {
+        return reinterpret_cast<const uchar*>(indexes.constData()) + index*ledCount;
+    }
+};
+
+/// Median cut color quantizer.
+/// The color histogram is built in parallel across frames (see PaletteAnalysis),
+/// and the histogram is sorted before it is cut, so the result only depends on
+/// the frame data and never on thread timing. If the frames already have few
+/// enough colors, they are used as the palette directly.
+///
+/// The results for the most recently used frames and palette sizes are cached,
+/// so that the indexed encoders (which are run at the same time by the
+/// EncodingSelector) and an export of the same frames only quantize them once.
+/// The cache lock is only held to look up and store results, so different
+/// frames can be quantized in parallel.
+class PaletteQuantizer
+{
+public:
+    /// Reduce a set of frames to a palette
+    /// @param frames Frames to quantize
+    /// @param maxColors Maximum number of colors in the palette, up to 256
+    /// @return Palette and per-LED palette indexes
+    static QuantizedFrames quantize(const FrameStore& frames, int maxColors = 256);
+
+private:
+    static QuantizedFrames buildPalette(const FrameStore& frames, int maxColors);
+};
+
+#endif // PALETTEQUANTIZER_H
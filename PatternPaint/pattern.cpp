@@ -1,48 +1,82 @@
 #include "pattern.h"
 #include "colormodel.h"
+#include "palettequantizer.h"
+#include "framecache.h"
 
 #include <QDebug>
 
-Pattern::Pattern(QImage image, int frameDelay, Encoding encoding) :
+Pattern::Pattern(QImage image, int frameDelay, Encoding encoding, ColorModel::Profile profile) :
     encoding(encoding),
-    image(image),
-    frameDelay(frameDelay)
+    frameDelay(frameDelay),
+    profile(profile)
 {
-    frameCount = image.width();
-    ledCount = image.height();
+    encode(FrameStore(image));
+}
+
+Pattern::Pattern(const FrameStore& frames, int frameDelay, Encoding encoding,
+                 ColorModel::Profile profile) :
+    encoding(encoding),
+    frameDelay(frameDelay),
+    profile(profile)
+{
+    encode(frames);
+}
+
+Pattern::Pattern(const QByteArray& data, Encoding encoding, int frameCount, int ledCount,
+                 int frameDelay, ColorModel::Profile profile) :
+    encoding(encoding),
+    data(data),
+    frameCount(frameCount),
+    ledCount(ledCount),
+    frameDelay(frameDelay),
+    lossless(true),
+    valid(true),
+    profile(profile)
+{
+}
+
+QList<Pattern::Encoding> Pattern::encodings()
+{
+    QList<Encoding> encodings;
+    encodings << RGB24 << RGB565_RLE << INDEXED << INDEXED_RLE;
+    return encodings;
+}
+
+void Pattern::encode(const FrameStore& frames)
+{
+    frameCount = frames.frameCount();
+    ledCount = frames.ledCount();
+    lossless = true;
+    valid = true;
+
+    data.clear();
 
     // Create a new encoder
     switch(encoding) {
     case RGB565_RLE:
-        encodeImageRGB16_RLE();
+        encodeImageRGB16_RLE(frames);
         break;
     case RGB24:
-        encodeImageRGB24();
+        encodeImageRGB24(frames);
         break;
     case INDEXED:
-        encodeImageIndexed();
+        encodeImageIndexed(frames);
         break;
     case INDEXED_RLE:
-        encodeImageIndexed_RLE();
+        encodeImageIndexed_RLE(frames);
+        break;
+    default:
+        qCritical() << "Unsupported encoding:" << encoding;
+        valid = false;
         break;
     }
 }
 
-int Pattern::colorCount() const
-{
-    // Brute force method for counting the number of unique colors in the image
-    QList<QRgb> colors;
-
-    for(int frame = 0; frame < image.width(); frame++) {
-        for(int pixel = 0; pixel < image.height(); pixel++) {
-            QRgb color = image.pixel(frame, pixel);
-            if(!colors.contains(color)) {
-                colors.append(color);
-            }
-        }
-    }
-
-    return colors.length();
+QByteArray Pattern::colorProfileContext() const {
+    // Encoded colors are brightness corrected, so they change with the profile
+    QByteArray context;
+    context.append(static_cast<char>(profile));
+    return context;
 }
 
 int Pattern::QRgbTo565(QRgb color) {
@@ -51,113 +85,104 @@ int Pattern::QRgbTo565(QRgb color) {
            | (((qBlue(color)  >> 3) & 0x1F)      );
 }
 
-void Pattern::encodeImageRGB16_RLE() {
-    data.clear();
-    header.clear(); // TODO: Move the header builder somewhere else?
+void Pattern::encodeImageRGB16_RLE(const FrameStore& frames) {
+    FrameCache cache(encoding, colorProfileContext());
 
-    header.append("const PROGMEM prog_uint8_t patternData[]  = {\n");
+    for(int frame = 0; frame < frames.frameCount(); frame++) {
+        QByteArray source = QByteArray::fromRawData(
+                    reinterpret_cast<const char*>(frames.frame(frame)), ledCount*3);
+        QByteArray encoded;
+        bool frameLossless;
 
-    for(int frame = 0; frame < image.width(); frame++) {
-        int currentColor;
-        int runCount = 0;
+        if(!cache.find(frames.frameHash(frame), source, encoded, frameLossless)) {
+            encoded = encodeFrameRGB16_RLE(frames.frame(frame), frameLossless);
+            cache.insert(frames.frameHash(frame), source, encoded, frameLossless);
+        }
 
-        for(int pixel = 0; pixel < image.height(); pixel++) {
-            QRgb color = ColorModel::correctBrightness(image.pixel(frame, pixel));
+        if(!frameLossless) {
+            lossless = false;
+        }
 
-            int decimatedColor = QRgbTo565(color);
+        data.append(encoded);
+    }
 
-            if(runCount == 0) {
-                currentColor = decimatedColor;
-            }
+    cache.save();
+}
 
-            if(currentColor != decimatedColor) {
-                int highByte = (currentColor >> 8) & 0xFF;
-                int lowByte  = (currentColor)      & 0xFF;
+QByteArray Pattern::encodeFrameRGB16_RLE(const uchar* frame, bool& frameLossless) {
+    QByteArray encoded;
+    QByteArray corrected(ledCount*3, 0);
+    uchar* correctedData = reinterpret_cast<uchar*>(corrected.data());
 
-                data.append(runCount);
-                data.append(highByte);
-                data.append(lowByte);
+    int currentColor;
+    int runCount = 0;
 
-                header.append(QString("  %1, 0x%2, 0x%3,\n")
-                              .arg(runCount, 3)
-                              .arg(highByte, 2, 16, QLatin1Char('0'))
-                              .arg(lowByte,  2, 16, QLatin1Char('0')));
+    frameLossless = true;
 
-                runCount = 1;
-                currentColor = decimatedColor;
-            }
-            else {
-                runCount++;
-            }
+    ColorModel::correctBrightness(frame, ledCount, correctedData, profile);
+
+    for(int pixel = 0; pixel < ledCount; pixel++) {
+        QRgb color = qRgb(correctedData[pixel*3],
+                          correctedData[pixel*3 + 1],
+                          correctedData[pixel*3 + 2]);
+
+        int decimatedColor = QRgbTo565(color);
+
+        // Any bits dropped by the decimation are lost
+        if((qRed(color) & 0x07) || (qGreen(color) & 0x03) || (qBlue(color) & 0x07)) {
+            frameLossless = false;
         }
 
-        int highByte = (currentColor >> 8) & 0xFF;
-        int lowByte  = (currentColor)      & 0xFF;
+        if(runCount == 0) {
+            currentColor = decimatedColor;
+        }
 
-        data.append(runCount);
-        data.append(highByte);
-        data.append(lowByte);
+        // Runs are split when they don't fit in the run count
+        if(currentColor != decimatedColor || runCount == RLE_MAX_RUN_LENGTH) {
+            encoded.append(runCount);
+            encoded.append((currentColor >> 8) & 0xFF);
+            encoded.append((currentColor)      & 0xFF);
 
-        header.append(QString("  %1, 0x%2, 0x%3,\n")
-                      .arg(runCount, 3)
-                      .arg(highByte, 2, 16, QLatin1Char('0'))
-                      .arg(lowByte,  2, 16, QLatin1Char('0')));
+            runCount = 1;
+            currentColor = decimatedColor;
+        }
+        else {
+            runCount++;
+        }
     }
 
-    header.append("};\n\n");
-    header.append(QString("Pattern pattern(%1, patternData, ENCODING_RGB565_RLE, %2);\n")
-                  .arg(image.width())
-                  .arg(image.height()));
-}
-
+    encoded.append(runCount);
+    encoded.append((currentColor >> 8) & 0xFF);
+    encoded.append((currentColor)      & 0xFF);
 
-void Pattern::encodeImageRGB24() {
-    // TODO: build c++ header as well
+    return encoded;
+}
 
-    data.clear();
 
-    for(int frame = 0; frame < image.width(); frame++) {
-        for(int pixel = 0; pixel < image.height(); pixel++) {
-            QRgb color = ColorModel::correctBrightness(image.pixel(frame, pixel));
-            data.append(qRed(color));
-            data.append(qGreen(color));
-            data.append(qBlue(color));
-        }
+void Pattern::encodeImageRGB24(const FrameStore& frames) {
+    // Frames are stored contiguously, so the whole pattern can be corrected at once
+    data = QByteArray(frames.frameCount()*ledCount*3, 0);
+    if(frames.frameCount()*ledCount > 0) {
+        ColorModel::correctBrightness(frames.frame(0), frames.frameCount()*ledCount,
+                                      reinterpret_cast<uchar*>(data.data()), profile);
     }
 }
 
-void Pattern::encodeImageIndexed() {
-    header.clear();
-    data.clear();
-
-    // First, convert to an indexed format. This should be non-destructive
-    // if the image had fewer than 256 colors.
-    QImage indexed = image.convertToFormat(
-                QImage::Format_Indexed8,
-                Qt::AutoColor & Qt::AvoidDither);
-    qDebug() << "Original color count:" << colorCount();
-    qDebug() << "Indexed color count: " << indexed.colorCount();
+QuantizedFrames Pattern::buildColorTable(const FrameStore& frames) {
+    // Reduce the frames to a palette. This is non-destructive if the frames
+    // have 256 or fewer colors. The result is cached, so the other indexed
+    // encoders can reuse it.
+    QuantizedFrames indexed = PaletteQuantizer::quantize(frames);
 
-    header.append("const PROGMEM prog_uint8_t patternData[]  = {\n");
+    lossless = indexed.lossless;
 
     // Record the length of the color table
-    header.append("// Length of the color table - 1, in bytes. length: 1 byte\n");
-    header.append(QString(" %1,\n")
-                  .arg(indexed.colorCount() - 1, 3));
-
-    data.append(indexed.colorCount() - 1);
+    data.append(indexed.palette.size() - 1);
 
     // Build the color table
-    header.append(QString("// Color table section. Each entry is 3 bytes. length: %1 bytes\n")
-                  .arg(indexed.colorCount()*3));
-
-    for (int index = 0; index < indexed.colorCount(); index++) {
-        QRgb color = ColorModel::correctBrightness(indexed.color(index));
-
-        header.append(QString(" %1, %2, %3,\n")
-                          .arg(qRed(color),   3)
-                          .arg(qGreen(color), 3)
-                          .arg(qBlue(color),  3));
+    for (int index = 0; index < indexed.palette.size(); index++) {
+        // TODO: Brightness correction before pallete reduction?
+        QRgb color = ColorModel::correctBrightness(indexed.palette[index], profile);
 
         /// Colors in the color table are stored in RGB24 format
         data.append(qRed(color));
@@ -165,118 +190,75 @@ void Pattern::encodeImageIndexed() {
         data.append(qBlue(color));
     }
 
+    return indexed;
+}
 
-    // Build the pixel table
-    header.append(QString("// Pixel table section. Each pixel is 1 byte. length: %1 bytes\n")
-                  .arg(image.width()*image.height()));
-
-    for(int frame = 0; frame < image.width(); frame++) {
-        for(int pixel = 0; pixel < image.height(); pixel++) {
-            int index = indexed.pixelIndex(frame, pixel);
-            header.append(QString(" %1,").arg(index, 3));
-
-            if (((pixel + frame*image.height()) % 10 == 9)) {
-                header.append("\n");
-            }
+void Pattern::encodeImageIndexed(const FrameStore& frames) {
+    QuantizedFrames indexed = buildColorTable(frames);
 
-            /// Pixel indexes are stired as 8-bit indexes
-            data.append(index);
-        }
+    // Build the pixel table
+    for(int frame = 0; frame < frames.frameCount(); frame++) {
+        /// Pixel indexes are stired as 8-bit indexes
+        data.append(reinterpret_cast<const char*>(indexed.frame(frame)), ledCount);
     }
-
-    header.append("\n};\n\n");
-    header.append(QString("Pattern pattern(%1, patternData, ENCODING_INDEXED, %2);\n")
-                  .arg(image.width())
-                  .arg(image.height()));
-
-    qDebug() << "Pattern size:" << data.length();
 }
 
-void Pattern::encodeImageIndexed_RLE() {
-    header.clear();
-    data.clear();
+void Pattern::encodeImageIndexed_RLE(const FrameStore& frames) {
+    int tableLength = data.length();
+    QuantizedFrames indexed = buildColorTable(frames);
 
-    // First, convert to an indexed format. This should be non-destructive
-    // if the image had fewer than 256 colors.
-    QImage indexed = image.convertToFormat(
-                QImage::Format_Indexed8,
-                Qt::AutoColor & Qt::AvoidDither);
-    qDebug() << "Original color count:" << colorCount();
-    qDebug() << "Indexed color count: " << indexed.colorCount();
+    // The indexes depend on the palette, so frames can only be reused while
+    // the color table stays the same.
+    QByteArray context = colorProfileContext();
+    context.append(data.mid(tableLength));
 
-    header.append("const PROGMEM prog_uint8_t patternData[]  = {\n");
+    FrameCache cache(encoding, context);
 
-    // Record the length of the color table
-    header.append("// Length of the color table - 1, in bytes. length: 1 byte\n");
-    header.append(QString(" %1,\n")
-                  .arg(indexed.colorCount() - 1, 3));
+    // Build the pixel runs
+    for(int frame = 0; frame < frames.frameCount(); frame++) {
+        QByteArray source = QByteArray::fromRawData(
+                    reinterpret_cast<const char*>(frames.frame(frame)), ledCount*3);
+        QByteArray encoded;
+        bool frameLossless;
 
-    data.append(indexed.colorCount() - 1);
+        if(!cache.find(frames.frameHash(frame), source, encoded, frameLossless)) {
+            encoded = encodeFrameIndexed_RLE(indexed.frame(frame));
+            cache.insert(frames.frameHash(frame), source, encoded, true);
+        }
 
-    // Build the color table
-    header.append(QString("// Color table section. Each entry is 3 bytes. length: %1 bytes\n")
-                  .arg(indexed.colorCount()*3));
+        data.append(encoded);
+    }
 
-    for (int index = 0; index < indexed.colorCount(); index++) {
-        // TODO: Brightness correction before pallete reduction?
-        QRgb color = ColorModel::correctBrightness(indexed.color(index));
+    cache.save();
+}
 
-        header.append(QString(" %1, %2, %3,\n")
-                          .arg(qRed(color),   3)
-                          .arg(qGreen(color), 3)
-                          .arg(qBlue(color),  3));
-
-        /// Colors in the color table are stored in RGB24 format
-        data.append(qRed(color));
-        data.append(qGreen(color));
-        data.append(qBlue(color));
-    }
+QByteArray Pattern::encodeFrameIndexed_RLE(const uchar* indexes) {
+    QByteArray encoded;
+    int currentColor;
+    int runCount = 0;
 
+    for(int pixel = 0; pixel < ledCount; pixel++) {
+        int newColor = indexes[pixel];
 
-    // Build the pixel table
-    header.append(QString("// Pixel runs section. Each pixel run is 2 bytes. length: %1 bytes\n")
-                  .arg(-1));
-
-    for(int frame = 0; frame < image.width(); frame++) {
-        int currentColor;
-        int runCount = 0;
-
-        for(int pixel = 0; pixel < image.height(); pixel++) {
-            int newColor = indexed.pixelIndex(frame, pixel);
-
-            if(runCount == 0) {
-                currentColor = newColor;
-            }
-
-            if(currentColor != newColor) {
-                header.append(QString(" %1, %2,\n")
-                              .arg(runCount, 3)
-                              .arg(currentColor, 3));
-
-                data.append(runCount);
-                data.append(currentColor);
-
-                runCount = 1;
-                currentColor = newColor;
-            }
-            else {
-                runCount++;
-            }
+        if(runCount == 0) {
+            currentColor = newColor;
         }
 
-        header.append(QString(" %1, %2,\n")
-                      .arg(runCount, 3)
-                      .arg(currentColor, 3));
+        // Runs are split when they don't fit in the run count
+        if(currentColor != newColor || runCount == RLE_MAX_RUN_LENGTH) {
+            encoded.append(runCount);
+            encoded.append(currentColor);
 
-        data.append(runCount);
-        data.append(currentColor);
+            runCount = 1;
+            currentColor = newColor;
+        }
+        else {
+            runCount++;
+        }
     }
 
-    header.append("\n};\n\n");
-    header.append(QString("Pattern pattern(%1, patternData, ENCODING_INDEXED_RLE, %2);\n")
-                  .arg(image.width())
-                  .arg(image.height()));
+    encoded.append(runCount);
+    encoded.append(currentColor);
 
-    qDebug() << "Pattern size:" << data.length();
+    return encoded;
 }
-
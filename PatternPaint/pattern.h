@@ -2,10 +2,19 @@
 #define PATTERN_H
 
 #include <QImage>
-#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include "framestore.h"
+#include "palettequantizer.h"
+#include "colormodel.h"
+
+#define RLE_MAX_RUN_LENGTH  255     // Longest run that fits in the 1-byte run count of the RLE encodings
 
 /// Container for a compressed pattern
-/// This class performs a 1-shot compression of an image from a QIMage.
+/// This class performs a 1-shot compression of an image from a QIMage or FrameStore.
+/// Only the encoded data is kept; use PatternHeaderWriter to produce a C++
+/// header from it.
 class Pattern
 {
 public:
@@ -16,21 +25,35 @@ public:
         INDEXED_RLE = 3,     /// 8-bit indexed mode + RLE (pallated 8 bit)
     };
 
-    // Create an pattern from a QImage
-    Pattern(QImage image, int frameDelay, Encoding encoding);
+    /// Get a list of all of the available encodings
+    static QList<Encoding> encodings();
+
+    // Create an pattern from a QImage. Colors are brightness corrected with
+    // the given profile, which the caller should read once with
+    // ColorModel::getProfile() so that encoders on worker threads all use it.
+    Pattern(QImage image, int frameDelay, Encoding encoding, ColorModel::Profile profile);
+
+    // Create an pattern from a frame store
+    Pattern(const FrameStore& frames, int frameDelay, Encoding encoding,
+            ColorModel::Profile profile);
 
-    // TODO: create an pattern from byte array
+    // Create a pattern from data that is already encoded, such as a pattern
+    // read back from a device. Use PatternDecoder to get the frames back.
+    Pattern(const QByteArray& data, Encoding encoding, int frameCount, int ledCount,
+            int frameDelay, ColorModel::Profile profile);
 
     Encoding encoding;  /// Encoding used to compress the pattern
-    QImage image;       /// QImage representation of the pattern
     QByteArray data;    /// Byte array representation of the pattern
-    QString header;     /// C++ header representation of the pattern
 
     int frameCount;     /// Number of frames in this pattern
     int ledCount;       /// Number of LEDs in this tape
     int frameDelay;     /// Length of time between frames of data, in ms
 
-    int colorCount() const;  /// Number of unique colors in the original image
+    bool lossless;      /// True if the encoded data reproduces the image exactly
+
+    bool valid;         /// False if the frames couldn't be stored in this encoding
+
+    ColorModel::Profile profile;    /// Gamma profile the colors were corrected with
 
 private:
     // Compress an RGB color to the 565 color space
@@ -38,10 +61,23 @@ private:
     // decimation.
     int QRgbTo565(QRgb color);
 
-    void encodeImageRGB24();
-    void encodeImageRGB16_RLE();
-    void encodeImageIndexed();
-    void encodeImageIndexed_RLE();
+    void encode(const FrameStore& frames);
+
+    void encodeImageRGB24(const FrameStore& frames);
+    void encodeImageRGB16_RLE(const FrameStore& frames);
+    void encodeImageIndexed(const FrameStore& frames);
+    void encodeImageIndexed_RLE(const FrameStore& frames);
+
+    // Encode a single frame. These are cached by the encoders above, so that
+    // frames which haven't changed since the last encoding are reused.
+    QByteArray encodeFrameRGB16_RLE(const uchar* frame, bool& frameLossless);
+    QByteArray encodeFrameIndexed_RLE(const uchar* indexes);
+
+    /// Cache context for encoders whose output depends on the color profile
+    QByteArray colorProfileContext() const;
+
+    /// Reduce the frames to a palette, and write the color table
+    QuantizedFrames buildColorTable(const FrameStore& frames);
 };
 
 
@@ -0,0 +1,299 @@
+#include "patterndecoder.h"
+#include "colormodel.h"
+
+#include <cstring>
+
+PatternDecoder::PatternDecoder(const Pattern& pattern) :
+    pattern(pattern),
+    framesStart(0),
+    currentFrame(-1),
+    position(0),
+    output(pattern.ledCount*3, 0)
+{
+    memset(&work, 0, sizeof(work));
+    readHeader();
+    reset();
+}
+
+bool PatternDecoder::isValid() const
+{
+    return errorString.isEmpty();
+}
+
+QString PatternDecoder::getErrorString() const
+{
+    return errorString;
+}
+
+void PatternDecoder::readHeader()
+{
+    position = 0;
+
+    // Indexed patterns start with the color table
+    if(pattern.encoding == Pattern::INDEXED || pattern.encoding == Pattern::INDEXED_RLE) {
+        if(canRead(1)) {
+            int colorTableLength = 1 + 3*(static_cast<uchar>(pattern.data.at(0)) + 1);
+            if(canRead(colorTableLength)) {
+                colors = pattern.data.left(colorTableLength);
+                position = colorTableLength;
+            }
+        }
+
+        // Skip the color count, so that colors only holds the colors
+        colors.remove(0, 1);
+    }
+
+    framesStart = position;
+}
+
+void PatternDecoder::reset()
+{
+    currentFrame = -1;
+    position = framesStart;
+    output.fill(0);
+}
+
+bool PatternDecoder::canRead(int length)
+{
+    if(position < 0 || position + length > pattern.data.length()) {
+        if(errorString.isEmpty()) {
+            errorString = QString("Pattern data ended early, at offset %1.").arg(position);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+uchar PatternDecoder::readByte()
+{
+    if(!canRead(1)) {
+        return 0;
+    }
+
+    return static_cast<uchar>(pattern.data.at(position++));
+}
+
+bool PatternDecoder::readColor(int index, uchar* color)
+{
+    if(index*3 + 2 >= colors.length()) {
+        errorString = QString("Color %1 is not in the color table.").arg(index);
+        return false;
+    }
+
+    memcpy(color, colors.constData() + index*3, 3);
+    work.lookups++;
+    return true;
+}
+
+bool PatternDecoder::nextFrame()
+{
+    if(!isValid() || currentFrame + 1 >= pattern.frameCount) {
+        return false;
+    }
+
+    currentFrame++;
+
+    memset(&work, 0, sizeof(work));
+    int frameStart = position;
+
+    bool result = decodeFrame();
+
+    work.bytesRead = position - frameStart;
+    return result;
+}
+
+bool PatternDecoder::decodeFrame()
+{
+    switch(pattern.encoding) {
+    case Pattern::RGB24:
+        return decodeRGB24();
+    case Pattern::RGB565_RLE:
+        return decodeRGB565_RLE();
+    case Pattern::INDEXED:
+        return decodeIndexed();
+    case Pattern::INDEXED_RLE:
+        return decodeIndexed_RLE();
+    default:
+        errorString = QString("Unsupported encoding %1.").arg(pattern.encoding);
+        return false;
+    }
+}
+
+int PatternDecoder::frameIndex() const
+{
+    return currentFrame;
+}
+
+const PatternDecoder::FrameWork& PatternDecoder::frameWork() const
+{
+    return work;
+}
+
+const uchar* PatternDecoder::frame() const
+{
+    return reinterpret_cast<const uchar*>(output.constData());
+}
+
+FrameStore PatternDecoder::decodeAll()
+{
+    reset();
+
+    QByteArray frames;
+    frames.reserve(pattern.frameCount*pattern.ledCount*3);
+
+    while(nextFrame()) {
+        frames.append(output);
+    }
+
+    if(!isValid()) {
+        return FrameStore();
+    }
+
+    return FrameStore(pattern.frameCount, pattern.ledCount, frames);
+}
+
+QImage PatternDecoder::toImage()
+{
+    FrameStore frames = decodeAll();
+    if(!isValid()) {
+        return QImage();
+    }
+
+    return frames.toImage();
+}
+
+bool PatternDecoder::matches(const FrameStore& source)
+{
+    if(source.frameCount() != pattern.frameCount || source.ledCount() != pattern.ledCount) {
+        errorString = QString("Pattern has %1 frames of %2 LEDs, but its source has %3 frames of %4 LEDs.")
+                .arg(pattern.frameCount).arg(pattern.ledCount)
+                .arg(source.frameCount()).arg(source.ledCount());
+        return false;
+    }
+
+    reset();
+
+    // Frames are checked as they are decoded, so the whole pattern is never
+    // held in memory
+    QByteArray expected(pattern.ledCount*3, 0);
+
+    while(nextFrame()) {
+        if(!pattern.lossless) {
+            continue;
+        }
+
+        ColorModel::correctBrightness(source.frame(currentFrame), pattern.ledCount,
+                                      reinterpret_cast<uchar*>(expected.data()), pattern.profile);
+
+        if(output != expected) {
+            errorString = QString("Frame %1 doesn't match the frame it was encoded from.")
+                    .arg(currentFrame);
+            return false;
+        }
+    }
+
+    return isValid();
+}
+
+bool PatternDecoder::decodeRGB24()
+{
+    int length = pattern.ledCount*3;
+    if(!canRead(length)) {
+        return false;
+    }
+
+    memcpy(output.data(), pattern.data.constData() + position, length);
+    position += length;
+    work.pixels = pattern.ledCount;
+    return true;
+}
+
+bool PatternDecoder::decodeRGB565_RLE()
+{
+    uchar* out = reinterpret_cast<uchar*>(output.data());
+
+    int pixel = 0;
+    while(pixel < pattern.ledCount) {
+        int runCount = readByte();
+        int upper = readByte();
+        int lower = readByte();
+
+        if(!isValid()) {
+            return false;
+        }
+        if(runCount == 0 || pixel + runCount > pattern.ledCount) {
+            errorString = QString("Invalid run length %1 in frame %2.")
+                    .arg(runCount).arg(currentFrame);
+            return false;
+        }
+
+        // Expand the 565 color the same way that the Animation library does
+        uchar red = upper & 0xF8;
+        uchar green = ((upper & 0x07) << 5) | ((lower & 0xE0) >> 3);
+        uchar blue = (lower & 0x1F) << 3;
+
+        work.runs++;
+        work.pixels += runCount;
+
+        for(int i = 0; i < runCount; i++, pixel++) {
+            out[pixel*3    ] = red;
+            out[pixel*3 + 1] = green;
+            out[pixel*3 + 2] = blue;
+        }
+    }
+
+    return true;
+}
+
+bool PatternDecoder::decodeIndexed()
+{
+    uchar* out = reinterpret_cast<uchar*>(output.data());
+
+    if(!canRead(pattern.ledCount)) {
+        return false;
+    }
+
+    for(int pixel = 0; pixel < pattern.ledCount; pixel++) {
+        if(!readColor(readByte(), out + pixel*3)) {
+            return false;
+        }
+    }
+
+    work.pixels = pattern.ledCount;
+    return true;
+}
+
+bool PatternDecoder::decodeIndexed_RLE()
+{
+    uchar* out = reinterpret_cast<uchar*>(output.data());
+
+    int pixel = 0;
+    while(pixel < pattern.ledCount) {
+        int runCount = readByte();
+        int index = readByte();
+
+        if(!isValid()) {
+            return false;
+        }
+        if(runCount == 0 || pixel + runCount > pattern.ledCount) {
+            errorString = QString("Invalid run length %1 in frame %2.")
+                    .arg(runCount).arg(currentFrame);
+            return false;
+        }
+
+        uchar color[3];
+        if(!readColor(index, color)) {
+            return false;
+        }
+
+        work.runs++;
+        work.pixels += runCount;
+
+        for(int i = 0; i < runCount; i++, pixel++) {
+            memcpy(out + pixel*3, color, 3);
+        }
+    }
+
+    return true;
+}
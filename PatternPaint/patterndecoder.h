@@ -0,0 +1,120 @@
+#ifndef PATTERNDECODER_H
+#define PATTERNDECODER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include "pattern.h"
+#include "framestore.h"
+
+/// Decode the data of an encoded pattern back into frames.
+/// The decoder follows the same steps as the PatternPlayer sketch, so the
+/// frames it produces are what the device will show: colors are brightness
+/// corrected, and any loss from the encoding (565 color, palette reduction)
+/// is visible.
+///
+/// Frames can be read one at a time, so that long patterns can be played or
+/// checked without decoding all of them at once:
+///
+///     PatternDecoder decoder(pattern);
+///     while(decoder.nextFrame()) {
+///         const uchar* frame = decoder.frame();
+///         ...
+///     }
+///     if(!decoder.isValid()) {
+///         qDebug() << decoder.getErrorString();
+///     }
+///
+/// or all at once, using decodeAll().
+class PatternDecoder
+{
+public:
+    /// Create a decoder for a pattern
+    /// @param pattern Pattern to decode
+    explicit PatternDecoder(const Pattern& pattern);
+
+    /// True if no errors have been found in the pattern data so far
+    bool isValid() const;
+
+    /// Get a string describing the last error, if any.
+    QString getErrorString() const;
+
+    /// Start decoding again from the first frame
+    void reset();
+
+    /// Decode the next frame
+    /// @return true if a frame was decoded, false at the end of the pattern,
+    /// or if the data is invalid
+    bool nextFrame();
+
+    /// Index of the most recently decoded frame, or -1 before the first one
+    int frameIndex() const;
+
+    /// Get the most recently decoded frame
+    /// @return Packed RGB24 data for the frame, ledCount*3 bytes long
+    const uchar* frame() const;
+
+    /// Work done to decode a frame, counted in the same steps that the
+    /// PatternPlayer sketch takes. Used to estimate how long the device needs
+    /// for each frame.
+    struct FrameWork {
+        int bytesRead;  ///< Bytes read from the pattern data
+        int runs;       ///< Runs read
+        int pixels;     ///< LEDs written
+        int lookups;    ///< Color table lookups
+    };
+
+    /// Get the work done to decode the most recently decoded frame
+    const FrameWork& frameWork() const;
+
+    /// Decode every frame of the pattern
+    /// @return Decoded frames, or an empty frame store if the data is invalid
+    FrameStore decodeAll();
+
+    /// Decode every frame of the pattern into an image, one frame per column
+    /// @return Decoded image, or a null image if the data is invalid
+    QImage toImage();
+
+    /// Decode every frame of the pattern, and check it against the frames that
+    /// the pattern was encoded from. A lossless pattern has to give back the
+    /// brightness corrected source frames exactly; a lossy one only has to
+    /// decode without errors.
+    /// @param source Frames that the pattern was encoded from
+    /// @return true if the pattern decodes back to the source frames
+    bool matches(const FrameStore& source);
+
+private:
+    Pattern pattern;
+
+    QByteArray colors;      ///< Color table, for indexed encodings
+    int framesStart;        ///< Offset of the first frame in the data
+
+    int currentFrame;       ///< Index of the most recently decoded frame
+    int position;           ///< Read position in the data
+    QByteArray output;      ///< Most recently decoded frame
+    FrameWork work;         ///< Work done to decode the most recently decoded frame
+
+    QString errorString;
+
+    /// Read the color table
+    void readHeader();
+
+    /// Check that there is enough data left for a read
+    bool canRead(int length);
+
+    uchar readByte();
+
+    /// Look up a color from the color table, setting an error if it is missing
+    bool readColor(int index, uchar* color);
+
+    /// Decode the frame at the read position, using the pattern's encoding
+    bool decodeFrame();
+
+    bool decodeRGB24();
+    bool decodeRGB565_RLE();
+    bool decodeIndexed();
+    bool decodeIndexed_RLE();
+};
+
+#endif // PATTERNDECODER_H
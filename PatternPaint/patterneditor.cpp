@@ -48,6 +48,7 @@ void PatternEditor::init(int frameCount, int stripLength)
                      stripLength,
                      QImage::Format_ARGB32_Premultiplied);
     pattern.fill(COLOR_CANVAS_DEFAULT);
+    modifiedRegion = pattern.rect();
 
     toolPreview = QImage(frameCount,
                          stripLength,
@@ -60,6 +61,8 @@ void PatternEditor::init(int frameCount, int stripLength)
     updateGridSize();
 
     update();
+
+    emit modified();
 }
 
 bool PatternEditor::init(QImage newPattern, bool scaled) {
@@ -77,6 +80,10 @@ bool PatternEditor::init(QImage newPattern, bool scaled) {
     // Draw the new pattern to the display
     QPainter painter(&pattern);
     painter.drawImage(0,0,newPattern);
+    painter.end();
+
+    modifiedRegion = pattern.rect();
+    emit modified();
 
     // and force a screen update
     update();
@@ -84,6 +91,15 @@ bool PatternEditor::init(QImage newPattern, bool scaled) {
     return true;
 }
 
+const FrameStore& PatternEditor::getFrameStore() {
+    if(!modifiedRegion.isEmpty()) {
+        frameStore.update(pattern, modifiedRegion);
+        modifiedRegion = QRect();
+    }
+
+    return frameStore;
+}
+
 void PatternEditor::updateGridSize() {
     // Base the widget size on the window height
     float scale = float(size().height() - 1)/pattern.height();
@@ -2,6 +2,7 @@
 #define PATTERNDITOR_H
 
 #include <QWidget>
+#include "framestore.h"
 
 class QUndoStack;
 class UndoCommand;
@@ -24,7 +25,7 @@ public:
     /// @param scaled If true, scale the image to match the height of the previous pattern
     bool init(QImage newPattern, bool scaled = true);
 
-    void setImage(const QImage& img) { pattern = img; }
+    void setImage(const QImage& img) { pattern = img; modifiedRegion = pattern.rect(); emit modified(); }
 
     inline QUndoStack* getUndoStack() { return m_undoStack; }
 
@@ -33,6 +34,15 @@ public:
     QImage getPatternAsImage() const { return pattern; }
     QImage* getPattern() { return &pattern; }
 
+    /// Notify the editor that a region of the pattern was drawn on directly,
+    /// through getPattern().
+    /// @param region Region of the pattern that was modified
+    void markModified(const QRect& region) { modifiedRegion = modifiedRegion.united(region); emit modified(); }
+
+    /// Get the current pattern as a frame store. Any modified frames are
+    /// brought up to date before it is returned.
+    const FrameStore& getFrameStore();
+
     bool isEdited() const { return m_edited; }
     void setEdited(bool e) { m_edited = e; }
 
@@ -60,6 +70,9 @@ private:
     QImage gridPattern;    ///< Holds the pre-rendered grid overlay
     QImage toolPreview;    ///< Holds a preview of the current tool
 
+    FrameStore frameStore; ///< Column-major copy of the pattern
+    QRect modifiedRegion;  ///< Region of the pattern not yet copied to the frame store
+
     float xScale;          ///< Number of pixels in the grid pattern per pattern pixel.
     float yScale;          ///< Number of pixels in the grid pattern per pattern pixel.
 
@@ -79,6 +92,8 @@ private:
     void lazyUpdate();
     void updateToolPreview(int x, int y);
 signals:
+    /// Sent whenever the pattern changes
+    void modified();
 
 public slots:
     void setToolColor(QColor color);
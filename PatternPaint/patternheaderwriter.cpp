@@ -0,0 +1,174 @@
+#include "patternheaderwriter.h"
+
+/// Write a decimal number, right-aligned in a 3 character field
+static inline void writeDecimal(QTextStream& stream, int value) {
+    stream << qSetFieldWidth(3) << value << qSetFieldWidth(0);
+}
+
+/// Write a byte as a 2 digit hex number, with a 0x prefix
+static inline void writeHex(QTextStream& stream, int value) {
+    stream << QString("0x%1").arg(value, 2, 16, QChar('0'));
+}
+
+/// Write a line of comma-separated decimal bytes
+static inline void writeBytes(QTextStream& stream, const uchar* data, int count,
+                              const char* indent = " ") {
+    stream << indent;
+    for(int i = 0; i < count; i++) {
+        if(i > 0) {
+            stream << ", ";
+        }
+        writeDecimal(stream, data[i]);
+    }
+    stream << ",\n";
+}
+
+void PatternHeaderWriter::write(const Pattern& pattern, QTextStream& stream)
+{
+    stream << "const PROGMEM prog_uint8_t patternData[]  = {\n";
+
+    int start = 0;
+
+    if(pattern.encoding == Pattern::INDEXED || pattern.encoding == Pattern::INDEXED_RLE) {
+        start = writeColorTable(pattern, stream);
+    }
+
+    writeFrames(pattern, stream, start);
+
+    stream << "};\n\n";
+    stream << "Pattern pattern(" << pattern.frameCount << ", patternData, "
+           << encodingName(pattern.encoding) << ", " << pattern.ledCount << ");\n";
+}
+
+QString PatternHeaderWriter::encodingName(Pattern::Encoding encoding)
+{
+    QString name;
+
+    switch(encoding) {
+    case Pattern::RGB24:
+        name = "ENCODING_RGB24";
+        break;
+    case Pattern::RGB565_RLE:
+        name = "ENCODING_RGB565_RLE";
+        break;
+    case Pattern::INDEXED:
+        name = "ENCODING_INDEXED";
+        break;
+    case Pattern::INDEXED_RLE:
+        name = "ENCODING_INDEXED_RLE";
+        break;
+    default:
+        name = QString::number(encoding);
+        break;
+    }
+
+    return name;
+}
+
+void PatternHeaderWriter::writeFrames(const Pattern& pattern, QTextStream& stream, int start)
+{
+    switch(pattern.encoding) {
+    case Pattern::RGB24:
+        writeRGB24(pattern, stream, start);
+        break;
+    case Pattern::RGB565_RLE:
+        writeRGB565_RLE(pattern, stream, start);
+        break;
+    case Pattern::INDEXED:
+        writeIndexed(pattern, stream, start);
+        break;
+    case Pattern::INDEXED_RLE:
+        writeIndexed_RLE(pattern, stream, start);
+        break;
+    default:
+        break;
+    }
+}
+
+void PatternHeaderWriter::writeRGB24(const Pattern& pattern, QTextStream& stream, int start)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(pattern.data.constData());
+
+    stream << "// Pixel data section. Each pixel is 3 bytes. length: "
+           << pattern.data.length() - start << " bytes\n";
+
+    for(int offset = start; offset + 2 < pattern.data.length(); offset += 3) {
+        writeBytes(stream, data + offset, 3);
+    }
+}
+
+void PatternHeaderWriter::writeRGB565_RLE(const Pattern& pattern, QTextStream& stream, int start)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(pattern.data.constData());
+
+    for(int offset = start; offset + 2 < pattern.data.length(); offset += 3) {
+        stream << "  ";
+        writeDecimal(stream, data[offset]);
+        stream << ", ";
+        writeHex(stream, data[offset + 1]);
+        stream << ", ";
+        writeHex(stream, data[offset + 2]);
+        stream << ",\n";
+    }
+}
+
+int PatternHeaderWriter::writeColorTable(const Pattern& pattern, QTextStream& stream)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(pattern.data.constData());
+    int colorCount = data[0] + 1;
+
+    // Record the length of the color table
+    stream << "// Length of the color table - 1, in bytes. length: 1 byte\n";
+    writeBytes(stream, data, 1);
+
+    // Build the color table
+    stream << "// Color table section. Each entry is 3 bytes. length: "
+           << colorCount*3 << " bytes\n";
+
+    for(int index = 0; index < colorCount; index++) {
+        writeBytes(stream, data + 1 + index*3, 3);
+    }
+
+    return 1 + colorCount*3;
+}
+
+void PatternHeaderWriter::writeIndexed(const Pattern& pattern, QTextStream& stream, int start)
+{
+    // Build the pixel table
+    stream << "// Pixel table section. Each pixel is 1 byte. length: "
+           << pattern.data.length() - start << " bytes\n";
+
+    writeByteTable(pattern, stream, start);
+}
+
+void PatternHeaderWriter::writeByteTable(const Pattern& pattern, QTextStream& stream, int start)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(pattern.data.constData());
+
+    for(int offset = start; offset < pattern.data.length(); offset++) {
+        stream << " ";
+        writeDecimal(stream, data[offset]);
+        stream << ",";
+
+        if((offset - start) % 10 == 9) {
+            stream << "\n";
+        }
+    }
+
+    stream << "\n";
+}
+
+void PatternHeaderWriter::writeIndexed_RLE(const Pattern& pattern, QTextStream& stream, int start)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(pattern.data.constData());
+
+    // Build the pixel table
+    stream << "// Pixel runs section. Each pixel run is 2 bytes. length: "
+           << pattern.data.length() - start << " bytes\n";
+
+    for(int offset = start; offset + 1 < pattern.data.length(); offset += 2) {
+        writeBytes(stream, data + offset, 2);
+    }
+
+    stream << "\n";
+}
@@ -0,0 +1,42 @@
+#ifndef PATTERNHEADERWRITER_H
+#define PATTERNHEADERWRITER_H
+
+#include <QTextStream>
+#include "pattern.h"
+
+/// Write an encoded pattern out as a C++ header, for use with the BlinkyTape
+/// Arduino library. The header is built from the pattern's encoded data on
+/// demand, and streamed directly to the output, so it never needs to be held
+/// in memory.
+class PatternHeaderWriter
+{
+public:
+    /// Write a pattern to a stream as a C++ header
+    /// @param pattern Pattern to write
+    /// @param stream Stream to write the header to
+    static void write(const Pattern& pattern, QTextStream& stream);
+
+private:
+    /// Get the name of an encoding, as used by the Arduino library
+    static QString encodingName(Pattern::Encoding encoding);
+
+    /// Write the frame data section of a pattern
+    /// @param pattern Pattern to write
+    /// @param stream Stream to write the header to
+    /// @param start Offset of the first frame in the pattern data
+    static void writeFrames(const Pattern& pattern, QTextStream& stream, int start);
+
+    static void writeRGB24(const Pattern& pattern, QTextStream& stream, int start);
+    static void writeRGB565_RLE(const Pattern& pattern, QTextStream& stream, int start);
+    static void writeIndexed(const Pattern& pattern, QTextStream& stream, int start);
+    static void writeIndexed_RLE(const Pattern& pattern, QTextStream& stream, int start);
+
+    /// Write the rest of the pattern data as a table of bytes, 10 to a line
+    static void writeByteTable(const Pattern& pattern, QTextStream& stream, int start);
+
+    /// Write the color table section of an indexed pattern
+    /// @return Offset of the first byte after the color table
+    static int writeColorTable(const Pattern& pattern, QTextStream& stream);
+};
+
+#endif // PATTERNHEADERWRITER_H
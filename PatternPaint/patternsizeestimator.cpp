@@ -0,0 +1,140 @@
+#include "patternsizeestimator.h"
+
+PatternSizeEstimator::PatternSizeEstimator()
+{
+    reset();
+}
+
+void PatternSizeEstimator::reset()
+{
+    frameCount = 0;
+    ledCount = 0;
+    profile = ColorModel::getProfile();
+    stats.clear();
+    colorCounts.clear();
+
+    rgb565Runs = 0;
+    colorRuns = 0;
+}
+
+void PatternSizeEstimator::update(const FrameStore& newFrames)
+{
+    // A different geometry or color profile changes every frame
+    if(newFrames.frameCount() != frameCount
+            || newFrames.ledCount() != ledCount
+            || profile != ColorModel::getProfile()) {
+        reset();
+        frameCount = newFrames.frameCount();
+        ledCount = newFrames.ledCount();
+        stats.resize(frameCount);
+
+        for(int index = 0; index < newFrames.frameCount(); index++) {
+            addFrame(newFrames, index);
+        }
+        return;
+    }
+
+    // Otherwise, only look at the frames that changed
+    for(int index = 0; index < newFrames.frameCount(); index++) {
+        if(stats[index].hash == newFrames.frameHash(index)) {
+            continue;
+        }
+
+        removeFrame(index);
+        addFrame(newFrames, index);
+    }
+}
+
+void PatternSizeEstimator::removeFrame(int index)
+{
+    const FrameStats& frame = stats[index];
+
+    rgb565Runs -= frame.rgb565Runs;
+    colorRuns -= frame.colorRuns;
+
+    QHash<QRgb, int>::const_iterator color;
+    for(color = frame.colors.constBegin(); color != frame.colors.constEnd(); ++color) {
+        QHash<QRgb, int>::iterator count = colorCounts.find(color.key());
+        if(count != colorCounts.end()) {
+            count.value() -= color.value();
+            if(count.value() <= 0) {
+                colorCounts.erase(count);
+            }
+        }
+    }
+}
+
+void PatternSizeEstimator::addFrame(const FrameStore& newFrames, int index)
+{
+    FrameStats& frame = stats[index];
+
+    frame.hash = newFrames.frameHash(index);
+    frame.rgb565Runs = 0;
+    frame.colorRuns = 0;
+    frame.colors.clear();
+
+    QByteArray corrected(ledCount*3, 0);
+    const uchar* correctedData = reinterpret_cast<const uchar*>(corrected.constData());
+    ColorModel::correctBrightness(newFrames.frame(index), ledCount,
+                                  reinterpret_cast<uchar*>(corrected.data()), profile);
+
+    const uchar* color = newFrames.frame(index);
+    QRgb lastColor = 0;
+    int last565 = -1;
+    int colorRunLength = 0;
+    int rgb565RunLength = 0;
+
+    // The encoders split runs that are longer than RLE_MAX_RUN_LENGTH
+    for(int led = 0; led < ledCount; led++) {
+        QRgb newColor = qRgb(color[led*3], color[led*3 + 1], color[led*3 + 2]);
+        frame.colors[newColor]++;
+
+        if(led == 0 || newColor != lastColor || colorRunLength == RLE_MAX_RUN_LENGTH) {
+            frame.colorRuns++;
+            colorRunLength = 0;
+        }
+        lastColor = newColor;
+        colorRunLength++;
+
+        // Same conversion as Pattern::QRgbTo565()
+        int new565 = ((correctedData[led*3    ] >> 3) << 11)
+                   | ((correctedData[led*3 + 1] >> 2) <<  5)
+                   | ((correctedData[led*3 + 2] >> 3)      );
+        if(new565 != last565 || rgb565RunLength == RLE_MAX_RUN_LENGTH) {
+            frame.rgb565Runs++;
+            rgb565RunLength = 0;
+        }
+        last565 = new565;
+        rgb565RunLength++;
+    }
+
+    rgb565Runs += frame.rgb565Runs;
+    colorRuns += frame.colorRuns;
+
+    QHash<QRgb, int>::const_iterator entry;
+    for(entry = frame.colors.constBegin(); entry != frame.colors.constEnd(); ++entry) {
+        colorCounts[entry.key()] += entry.value();
+    }
+}
+
+int PatternSizeEstimator::colorTableSize() const
+{
+    int colors = qMin(qMax(colorCounts.size(), 1), 256);
+    return 1 + colors*3;
+}
+
+int PatternSizeEstimator::estimate(Pattern::Encoding encoding) const
+{
+    switch(encoding) {
+    case Pattern::RGB24:
+        return frameCount*ledCount*3;
+    case Pattern::RGB565_RLE:
+        return rgb565Runs*3;
+    case Pattern::INDEXED:
+        return colorTableSize() + frameCount*ledCount;
+    case Pattern::INDEXED_RLE:
+        return colorTableSize() + colorRuns*2;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef PATTERNSIZEESTIMATOR_H
+#define PATTERNSIZEESTIMATOR_H
+
+#include <QHash>
+#include <QVector>
+#include "framestore.h"
+#include "pattern.h"
+#include "colormodel.h"
+
+/// Fast estimate of how large a pattern will be in each encoding, without
+/// running the encoders.
+///
+/// The estimator keeps the statistics that decide the encoded sizes (run counts
+/// and the set of colors) for each frame, but not the frames themselves, so
+/// that the editor's frame store isn't copied when it is next painted.
+/// When the frames are updated, only the frames whose hash changed are scanned
+/// again, so the estimate can follow the pattern while it is being painted.
+///
+/// RGB24 and RGB565_RLE sizes are exact. The indexed sizes are
+/// exact when the pattern has 256 or fewer colors; with more colors, palette
+/// reduction may merge runs, so the INDEXED_RLE size is an upper bound.
+class PatternSizeEstimator
+{
+public:
+    PatternSizeEstimator();
+
+    /// Bring the estimate up to date with a new version of the frames
+    /// @param frames Current frames of the pattern
+    void update(const FrameStore& frames);
+
+    /// Get the estimated size of the pattern data in an encoding
+    /// @param encoding Encoding to estimate
+    /// @return Estimated size in bytes, or -1 if the encoding can't be estimated
+    int estimate(Pattern::Encoding encoding) const;
+
+    /// Number of unique colors in the pattern
+    int colorCount() const { return colorCounts.size(); }
+
+private:
+    /// Statistics for a single frame
+    struct FrameStats {
+        uint hash;          ///< Hash of the frame data
+        int rgb565Runs;     ///< Number of runs in the RGB565_RLE encoding
+        int colorRuns;      ///< Number of runs of the same color
+        QHash<QRgb, int> colors;    ///< Number of LEDs with each color
+    };
+
+    int frameCount;                     ///< Number of frames the statistics were computed from
+    int ledCount;                       ///< Number of LEDs in each frame
+    ColorModel::Profile profile;        ///< Color profile the statistics were computed with
+    QVector<FrameStats> stats;          ///< Statistics for each frame
+
+    QHash<QRgb, int> colorCounts;       ///< Number of LEDs with each color
+
+    int rgb565Runs;             ///< Total runs in the RGB565_RLE encoding
+    int colorRuns;              ///< Total runs of the same color
+
+    void reset();
+
+    /// Remove a frame's statistics from the totals
+    void removeFrame(int index);
+
+    /// Add a frame's statistics to the totals, using the new frame data
+    void addFrame(const FrameStore& newFrames, int index);
+
+    /// Size of the color table for the indexed encodings
+    int colorTableSize() const;
+};
+
+#endif // PATTERNSIZEESTIMATOR_H
@@ -41,6 +41,10 @@ public:
     /// Get a string describing the last error, if any.
     virtual QString getErrorString() const = 0;
 
+    /// Set whether the device memory is read back and checked after it is
+    /// written. Uploaders that can't read the memory back ignore this.
+    virtual void setVerify(bool verify) { Q_UNUSED(verify); }
+
 signals:
     /// Sends an update about the maximum update progress, from 0 to 1
     void maxProgressChanged(int progress);
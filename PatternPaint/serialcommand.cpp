@@ -0,0 +1,93 @@
+#include "serialcommand.h"
+
+#include <QMetaObject>
+
+const QByteArray& ResponseParser::getResponse() const
+{
+    return response;
+}
+
+const QString& ResponseParser::getErrorString() const
+{
+    return errorString;
+}
+
+
+ExactResponseParser::ExactResponseParser(const QByteArray& expected) :
+    expected(expected)
+{
+}
+
+ResponseParser::Status ExactResponseParser::parse(QByteArray& data)
+{
+    int count = qMin(expected.length() - response.length(), data.length());
+
+    for(int i = 0; i < count; i++) {
+        if(data.at(i) != expected.at(response.length() + i)) {
+            errorString = QString("Expected %1, got %2")
+                    .arg(QString(expected.toHex()))
+                    .arg(QString(response.toHex() + data.left(i + 1).toHex()));
+            return Status_Error;
+        }
+    }
+
+    response.append(data.left(count));
+    data.remove(0, count);
+
+    if(response.length() < expected.length()) {
+        return Status_Incomplete;
+    }
+
+    return Status_Complete;
+}
+
+
+FixedLengthResponseParser::FixedLengthResponseParser(int length) :
+    length(length)
+{
+    response.reserve(length);
+}
+
+ResponseParser::Status FixedLengthResponseParser::parse(QByteArray& data)
+{
+    int count = qMin(length - response.length(), data.length());
+
+    response.append(data.left(count));
+    data.remove(0, count);
+
+    if(response.length() < length) {
+        return Status_Incomplete;
+    }
+
+    return Status_Complete;
+}
+
+
+SerialCommand::SerialCommand(int type,
+                             const QString& name,
+                             const QByteArray& data,
+                             ResponseParser* parser) :
+    type(type),
+    name(name),
+    data(data),
+    parser(parser),
+    member(0),
+    endsSession(false)
+{
+}
+
+void SerialCommand::setCompletionHandler(QObject* newReceiver, const char* newMember)
+{
+    receiver = newReceiver;
+    member = newMember;
+}
+
+void SerialCommand::complete() const
+{
+    if(receiver.isNull() || member == 0) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(receiver, member, Qt::DirectConnection,
+                              Q_ARG(QByteArray, parser->getResponse()));
+}
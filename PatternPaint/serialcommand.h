@@ -0,0 +1,100 @@
+#ifndef SERIALCOMMAND_H
+#define SERIALCOMMAND_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QString>
+
+/// Reads the response to a serial command, as its data arrives.
+///
+/// Each command gets its own parser, which is fed the received data until it
+/// has the whole response. Parsers consume data from the front of the receive
+/// buffer, and leave anything after their response for the next command.
+class ResponseParser
+{
+public:
+    enum Status {
+        Status_Incomplete,  ///< All of the data was consumed, and more is needed
+        Status_Complete,    ///< The whole response was received
+        Status_Error,       ///< The data isn't a valid response
+    };
+
+    virtual ~ResponseParser() {}
+
+    /// Parse received data
+    /// @param data Received data. Bytes that are part of the response are
+    /// removed from the front.
+    virtual Status parse(QByteArray& data) = 0;
+
+    /// Get the response, once parse() has returned Status_Complete
+    const QByteArray& getResponse() const;
+
+    /// Get a string describing why parse() returned Status_Error
+    const QString& getErrorString() const;
+
+protected:
+    QByteArray response;    ///< Data received so far
+    QString errorString;
+};
+
+/// Parser for a response that must match a known value, such as an
+/// acknowledgement. A mismatch is reported as soon as the first wrong byte
+/// arrives.
+class ExactResponseParser : public ResponseParser
+{
+public:
+    explicit ExactResponseParser(const QByteArray& expected);
+
+    Status parse(QByteArray& data);
+
+private:
+    QByteArray expected;    ///< Response that the device should send
+};
+
+/// Parser for a response of known length but unknown contents, such as a
+/// memory read. The buffer is allocated once, and filled as data arrives.
+class FixedLengthResponseParser : public ResponseParser
+{
+public:
+    explicit FixedLengthResponseParser(int length);
+
+    Status parse(QByteArray& data);
+
+private:
+    int length;     ///< Length of the response, in bytes
+};
+
+/// A command to send to a serial device, and how to read its response
+struct SerialCommand {
+    /// @param type Protocol-defined tag for the command, reported back when it finishes
+    /// @param name Human-readable description of the command, for debugging
+    /// @param data Data to send to the device
+    /// @param parser Parser for the response. The command takes ownership of it.
+    SerialCommand(int type,
+                  const QString& name,
+                  const QByteArray& data,
+                  ResponseParser* parser);
+
+    /// Call a slot on an object when the command finishes
+    /// @param receiver Object to call the slot on
+    /// @param member Name of the slot (without arguments). It is passed the
+    /// response, as a QByteArray.
+    void setCompletionHandler(QObject* receiver, const char* member);
+
+    /// Call the completion handler, if there is one
+    void complete() const;
+
+    int type;                               ///< Protocol-defined tag for the command
+    QString name;                           ///< Human-readable description of the command
+    QByteArray data;                        ///< Data to send to the device
+    QSharedPointer<ResponseParser> parser;  ///< Parser for the response
+
+    QPointer<QObject> receiver;             ///< Object to notify when the command finishes, if any
+    const char* member;                     ///< Slot to call on the receiver
+
+    bool endsSession;                       ///< If true, the device disconnects after this command
+};
+
+#endif // SERIALCOMMAND_H
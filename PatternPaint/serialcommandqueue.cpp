@@ -2,7 +2,9 @@
 
 #define COMMAND_TIMEOUT_TIME 1000
 
-SerialCommandQueue::SerialCommandQueue(QObject *parent) : QObject(parent)
+SerialCommandQueue::SerialCommandQueue(QObject *parent) :
+    QObject(parent),
+    windowSize(1)
 {
     serial = new QSerialPort(this);
     serial->setSettingsRestoredOnClose(false);
@@ -20,20 +22,24 @@ SerialCommandQueue::SerialCommandQueue(QObject *parent) : QObject(parent)
 
 
 bool SerialCommandQueue::open(QSerialPortInfo info) {
+#if defined(Q_OS_OSX)
+    // Note: This should be info.portName(). Changed here as a workaround for:
+    // https://bugreports.qt.io/browse/QTBUG-45127
+    return open(info.systemLocation());
+#else
+    return open(info.portName());
+#endif
+}
+
+bool SerialCommandQueue::open(const QString& portName) {
     if(isConnected()) {
         qCritical("Already connected to serial device");
         return false;
     }
 
-    qDebug() << "connecting to " << info.portName();
+    qDebug() << "connecting to " << portName;
 
-#if defined(Q_OS_OSX)
-    // Note: This should be info.portName(). Changed here as a workaround for:
-    // https://bugreports.qt.io/browse/QTBUG-45127
-    serial->setPortName(info.systemLocation());
-#else
-    serial->setPortName(info.portName());
-#endif
+    serial->setPortName(portName);
     serial->setBaudRate(QSerialPort::Baud115200);
 
     if( !serial->open(QIODevice::ReadWrite) ) {
@@ -41,6 +47,11 @@ bool SerialCommandQueue::open(QSerialPortInfo info) {
         return false;
     }
 
+    // Drop anything left over from an earlier session, so it isn't taken as
+    // the response to the first command
+    serial->clear(QSerialPort::AllDirections);
+    serial->clearError();
+
     return true;
 }
 
@@ -54,100 +65,116 @@ bool SerialCommandQueue::isConnected() {
     return serial->isOpen();
 }
 
-void SerialCommandQueue::queueCommand(QString name,
-                                 QByteArray data,
-                                 QByteArray expectedRespone) {
+void SerialCommandQueue::setWindowSize(int size) {
+    windowSize = qMax(1, size);
 
-    commandQueue.push_back(Command(name, data, expectedRespone));
+    // A bigger window might let more commands go out now
+    processCommandQueue();
+}
+
+int SerialCommandQueue::getWindowSize() const {
+    return windowSize;
+}
+
+int SerialCommandQueue::getCommandsInFlight() const {
+    return sentCommands.length();
+}
+
+void SerialCommandQueue::queueCommand(const SerialCommand& command) {
+
+    commandQueue.push_back(command);
 
     // Try to start processing commands.
     processCommandQueue();
 }
 
 void SerialCommandQueue::processCommandQueue() {
-    // Nothing to do if we don't have any commands...
-    if(commandQueue.length() == 0) {
-        return;
-    }
-
-    // Don't start a new command if one is already in progress
-    if(commandTimeoutTimer->isActive()) {
-        return;
-    }
+    // Keep sending commands until the window is full, or we run out
+    while(commandQueue.length() > 0 && sentCommands.length() < windowSize) {
+        if(!isConnected()) {
+            qCritical() << "Device disappeared, cannot run command";
+            return;
+        }
 
-    if(!isConnected()) {
-        qCritical() << "Device disappeared, cannot run command";
-        return;
-    }
+//        qDebug() << "Starting Command:" << commandQueue.front().name;
+        if(serial->write(commandQueue.front().data) != commandQueue.front().data.length()) {
+            qCritical() << "Error writing to device";
+            return;
+        }
 
-//    qDebug() << "Starting Command:" << commandQueue.front().name;
-    responseData.clear();
+        sentCommands.push_back(commandQueue.front());
+        commandQueue.pop_front();
 
-    if(serial->write(commandQueue.front().commandData) != commandQueue.front().commandData.length()) {
-        qCritical() << "Error writing to device";
-        return;
+        // Start the timer; the oldest command must complete before it fires, or it
+        // is considered an error. This is to prevent a misbehaving device from hanging
+        // the programmer code.
+        if(!commandTimeoutTimer->isActive()) {
+            commandTimeoutTimer->start(COMMAND_TIMEOUT_TIME);
+        }
     }
-
-    // Start the timer; the command must complete before it fires, or it
-    // is considered an error. This is to prevent a misbehaving device from hanging
-    // the programmer code.
-    commandTimeoutTimer->start(COMMAND_TIMEOUT_TIME);
 }
 
 void SerialCommandQueue::handleReadData() {
-    if(commandQueue.length() == 0) {
-        // TODO: error, we got unexpected data.
-        qCritical() << "Got data when we didn't expect it!";
-        return;
-    }
-
     if(isConnected()) {
         responseData.append(serial->readAll());
     }
 
-    if(responseData.length() > commandQueue.front().expectedResponse.length()) {
-        // TODO: error, we got unexpected data.
-        qCritical() << "Got more data than we expected";
-        return;
-    }
+    // Responses come back in the order the commands were sent, so feed the
+    // data to the oldest command's parser, for as long as there is any.
+    while(responseData.length() > 0) {
+        if(sentCommands.length() == 0) {
+            // TODO: error, we got unexpected data.
+            qCritical() << "Got data when we didn't expect it!";
+            responseData.clear();
+            return;
+        }
 
-    if(responseData.length() < commandQueue.front().expectedResponse.length()) {
-        qDebug() << "Didn't get enough data yet, so just waiting";
-        return;
-    }
+        ResponseParser::Status status = sentCommands.front().parser->parse(responseData);
 
-    // If the command was to read from flash, short-circuit the response data check.
-    if(commandQueue.front().name == "readFlash") {
-        if(responseData.at(responseData.length()-1) != '\r') {
-            qCritical() << "readFlash response didn't end with a \\r";
+        if(status == ResponseParser::Status_Incomplete) {
+            qDebug() << "Didn't get enough data yet, so just waiting";
             return;
         }
-    }
-    else if(responseData != commandQueue.front().expectedResponse) {
-        qCritical() << "Got unexpected data back";
-        return;
-    }
 
-    // At this point, we've gotten all of the data that we expected.
-    commandTimeoutTimer->stop();
+        if(status == ResponseParser::Status_Error) {
+            qCritical() << "Got unexpected data back for" << sentCommands.front().name
+                        << sentCommands.front().parser->getErrorString();
 
-//    qDebug() << "Command completed successfully: " << commandQueue.front().name;
-    emit(commandFinished(commandQueue.front().name,responseData));
+            // The rest of the data can't be matched to the commands in flight,
+            // so give up on them, like for a timeout
+            emit(error(sentCommands.front().parser->getErrorString()));
 
+            resetState();
+            return;
+        }
 
-    // If the command was reset, disconnect from the programmer and cancel
-    // any further commands
-    if(commandQueue.front().name == "reset") {
-        qDebug() << "Disconnecting from programmer";
+        // At this point, we've gotten all of the data that we expected. Remove
+        // the command before reporting it, so that any commands queued in
+        // response to it are sent after it.
+        SerialCommand finishedCommand = sentCommands.front();
+        sentCommands.pop_front();
 
-        resetState();
-        return;
-    }
+        commandTimeoutTimer->stop();
+        if(sentCommands.length() > 0) {
+            commandTimeoutTimer->start(COMMAND_TIMEOUT_TIME);
+        }
 
-    commandQueue.pop_front();
+//        qDebug() << "Command completed successfully: " << finishedCommand.name;
+        finishedCommand.complete();
+        emit(commandFinished(finishedCommand.type, finishedCommand.parser->getResponse()));
 
-    // Start another command, if there is one.
-    processCommandQueue();
+        // If the device is going away (for instance, after a reset), disconnect
+        // from it and cancel any further commands
+        if(finishedCommand.endsSession) {
+            qDebug() << "Disconnecting from programmer";
+
+            resetState();
+            return;
+        }
+
+        // Start another command, if there is one.
+        processCommandQueue();
+    }
 }
 
 void SerialCommandQueue::handleSerialError(QSerialPort::SerialPortError serialError)
@@ -176,5 +203,7 @@ void SerialCommandQueue::handleCommandTimeout()
 void SerialCommandQueue::resetState() {
     close();
     commandQueue.clear();
+    sentCommands.clear();
     responseData.clear();
+    commandTimeoutTimer->stop();
 }
@@ -4,13 +4,20 @@
 #include <QObject>
 #include <QtSerialPort>
 #include <QTimer>
+#include "serialcommand.h"
 
 // A command/response method to handle serial ports
 // This is to allow nonblocking, asyncronous commands to
-// be run against a serial port. Each command is expected
-// to have a response with a known length and value. A
+// be run against a serial port. Each command has a parser
+// that reads its response as the data arrives. A
 // command timeout handles devices that have become
 // unresponsive.
+//
+// Several commands can be sent before their responses come
+// back (see setWindowSize()), so that the link isn't idle
+// while waiting for each response. The device must answer
+// the commands in order, since responses are matched to
+// commands by their position in the queue.
 class SerialCommandQueue : public QObject
 {
     Q_OBJECT
@@ -18,16 +25,37 @@ public:
     explicit SerialCommandQueue(QObject *parent = 0);
 
     bool open(QSerialPortInfo info);
+
+    // Open a port by its name or path, for ports that QSerialPortInfo
+    // doesn't know about
+    bool open(const QString& portName);
+
     void close();
 
     bool isConnected();
 
+    // Set the number of commands that can be waiting for a response at once.
+    // Use 1 for devices that can't accept a command until they have answered
+    // the last one.
+    void setWindowSize(int size);
+
+    int getWindowSize() const;
+
+    // Get the number of commands that were sent and are waiting for a
+    // response. The queue is only cleared after error() is emitted, so a
+    // slot connected to it can use this to find out how many commands were
+    // in flight when the link failed.
+    int getCommandsInFlight() const;
+
     // Queue a new command
-    void queueCommand(QString name, QByteArray data, QByteArray expectedRespone);
+    void queueCommand(const SerialCommand& command);
 
 signals:
     void error(QString error);
-    void commandFinished(QString command, QByteArray returnData);
+
+    // Emitted after the command's completion handler is called
+    // @param type Type tag of the command
+    void commandFinished(int type, QByteArray returnData);
 
 public slots:
     // Handle receiving data from the serial port
@@ -40,28 +68,18 @@ public slots:
     void handleCommandTimeout();
 
 private:
-    struct Command {
-        Command(QString name_,
-                QByteArray command_,
-                QByteArray expectedResponse_) :
-            name(name_),
-            commandData(command_),
-            expectedResponse(expectedResponse_) {}
-
-        QString name;                   ///< Human-readable description of the command
-        QByteArray commandData;         ///< Data to send to the bootloader
-        QByteArray expectedResponse;    ///< Expected response from the bootloader
-    };
-
     QPointer<QSerialPort> serial;   ///< Serial device the programmer is attached to
 
-    QQueue<Command> commandQueue;   ///< Queue of commands to send
-    QByteArray responseData;        ///< Data received by the current command
+    QQueue<SerialCommand> commandQueue; ///< Queue of commands to send
+    QQueue<SerialCommand> sentCommands; ///< Commands that were sent, and are waiting for a response
+    QByteArray responseData;        ///< Data received, that no command's parser has consumed yet
+
+    int windowSize;                 ///< Maximum number of sent commands waiting for a response
 
     // Timer fires if a command has failed to complete quickly enough
     QPointer<QTimer> commandTimeoutTimer;
 
-    // If there is another command in the queue, start processing it.
+    // Send commands from the queue, until the window is full
     void processCommandQueue();
 
     void resetState();
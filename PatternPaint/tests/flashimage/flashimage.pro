@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_flashimage
+
+SOURCES += tst_flashimage.cpp \
+    $$PATTERNPAINT/flashimage.cpp
@@ -0,0 +1,270 @@
+#include <QtTest>
+
+#include "flashimage.h"
+
+// A small flash, so that the addresses in the tests are easy to follow
+#define TEST_FLASH_SIZE 1024
+#define TEST_PAGE_SIZE  128
+
+/// Checks that FlashImage places sections without overlapping them or running
+/// off the end of the flash, and that it reports the pages to write.
+class TestFlashImage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void addSection();
+    void addSectionUnaligned();
+
+    void addSectionOutOfRange_data();
+    void addSectionOutOfRange();
+
+    void addSectionOverlap();
+
+    void allocateSmallestGap();
+    void allocateLowestOfEqualGaps();
+    void allocateNoRoom();
+
+    void updateSection();
+
+    void freeSpace();
+    void largestFreeSpace();
+
+    void toByteArray();
+    void dirtyPages();
+    void mergePages();
+};
+
+/// Make a block of data, filled with one value
+static QByteArray fill(int length, char value)
+{
+    return QByteArray(length, value);
+}
+
+void TestFlashImage::addSection()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("b", 256, fill(10, 'b')));
+    QVERIFY(image.addSection("a", 0, fill(10, 'a')));
+
+    // Sections are kept in address order, whatever order they were added in
+    QCOMPARE(image.getSections().length(), 2);
+    QCOMPARE(image.getSections().at(0).name, QString("a"));
+    QCOMPARE(image.getSections().at(1).name, QString("b"));
+
+    QVERIFY(image.findSection("b") != 0);
+    QCOMPARE(image.findSection("b")->address, 256);
+    QVERIFY(image.findSection("c") == 0);
+}
+
+void TestFlashImage::addSectionUnaligned()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(!image.addSection("unaligned", 10, fill(10, 'u')));
+    QVERIFY(!image.getErrorString().isEmpty());
+    QVERIFY(image.getSections().isEmpty());
+}
+
+void TestFlashImage::addSectionOutOfRange_data()
+{
+    QTest::addColumn<int>("address");
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("before the flash") << -TEST_PAGE_SIZE << 10;
+    QTest::newRow("after the flash") << TEST_FLASH_SIZE << 1;
+    QTest::newRow("over the end") << TEST_FLASH_SIZE - TEST_PAGE_SIZE << TEST_PAGE_SIZE + 1;
+    QTest::newRow("larger than the flash") << 0 << TEST_FLASH_SIZE + 1;
+}
+
+void TestFlashImage::addSectionOutOfRange()
+{
+    QFETCH(int, address);
+    QFETCH(int, length);
+
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(!image.addSection("section", address, fill(length, 's')));
+    QVERIFY(!image.getErrorString().isEmpty());
+    QVERIFY(image.getSections().isEmpty());
+}
+
+void TestFlashImage::addSectionOverlap()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("first", 0, fill(TEST_PAGE_SIZE + 1, 'f')));
+
+    // Starts inside the last byte of the first section
+    QVERIFY(!image.addSection("overlapping", TEST_PAGE_SIZE, fill(10, 'o')));
+    QVERIFY(!image.getErrorString().isEmpty());
+
+    // Ending right where the next section starts is fine
+    QVERIFY(image.addSection("last", TEST_FLASH_SIZE - TEST_PAGE_SIZE, fill(TEST_PAGE_SIZE, 'l')));
+    QVERIFY(image.addSection("before last", TEST_FLASH_SIZE - 2*TEST_PAGE_SIZE,
+                             fill(TEST_PAGE_SIZE, 'b')));
+
+    QCOMPARE(image.getSections().length(), 3);
+}
+
+void TestFlashImage::allocateSmallestGap()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    // Leaves a 256 byte gap at 128, and a 512 byte gap at 512
+    QVERIFY(image.addSection("a", 0, fill(TEST_PAGE_SIZE, 'a')));
+    QVERIFY(image.addSection("b", 384, fill(TEST_PAGE_SIZE, 'b')));
+
+    QCOMPARE(image.allocateSection("small", fill(100, 's')), 128);
+
+    // Only fits in the gap at the end, once it is page aligned
+    QCOMPARE(image.allocateSection("large", fill(300, 'l')), 512);
+
+    // The gaps are now 156 bytes at 228, and 212 bytes at 812
+    QCOMPARE(image.allocateSection("unaligned", fill(20, 'u'), 1), 228);
+    QCOMPARE(image.allocateSection("word aligned", fill(200, 'w'), 2), 812);
+}
+
+void TestFlashImage::allocateLowestOfEqualGaps()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("a", 128, fill(TEST_PAGE_SIZE, 'a')));
+    QVERIFY(image.addSection("b", 384, fill(TEST_PAGE_SIZE, 'b')));
+    QVERIFY(image.addSection("c", 640, fill(3*TEST_PAGE_SIZE, 'c')));
+
+    // The gaps at 0 and 256 are both one page long
+    QCOMPARE(image.allocateSection("first", fill(64, '1')), 0);
+    QCOMPARE(image.allocateSection("second", fill(64, '2')), 256);
+}
+
+void TestFlashImage::allocateNoRoom()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("a", 0, fill(TEST_FLASH_SIZE - 100, 'a')));
+
+    // 100 bytes are free, but not on a page boundary
+    QCOMPARE(image.allocateSection("aligned", fill(50, 'b')), -1);
+    QVERIFY(!image.getErrorString().isEmpty());
+
+    QCOMPARE(image.allocateSection("too large", fill(101, 'c'), 1), -1);
+    QCOMPARE(image.getSections().length(), 1);
+
+    QCOMPARE(image.allocateSection("exact", fill(100, 'd'), 1), TEST_FLASH_SIZE - 100);
+    QCOMPARE(image.freeSpace(), 0);
+}
+
+void TestFlashImage::updateSection()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("table", 0, fill(10, 't')));
+    QVERIFY(image.addSection("next", TEST_PAGE_SIZE, fill(10, 'n')));
+
+    // A section can grow up to the next one, but not into it
+    QVERIFY(image.updateSection("table", fill(TEST_PAGE_SIZE, 'T')));
+    QCOMPARE(image.findSection("table")->data, fill(TEST_PAGE_SIZE, 'T'));
+
+    QVERIFY(!image.updateSection("table", fill(TEST_PAGE_SIZE + 1, 'X')));
+    QVERIFY(!image.getErrorString().isEmpty());
+    QCOMPARE(image.findSection("table")->data, fill(TEST_PAGE_SIZE, 'T'));
+
+    // Or off the end of the flash
+    QVERIFY(!image.updateSection("next", fill(TEST_FLASH_SIZE, 'X')));
+
+    QVERIFY(!image.updateSection("missing", fill(1, 'm')));
+}
+
+void TestFlashImage::freeSpace()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+    QCOMPARE(image.freeSpace(), TEST_FLASH_SIZE);
+
+    QVERIFY(image.addSection("a", 0, fill(10, 'a')));
+    QVERIFY(image.allocateSection("b", fill(20, 'b')) >= 0);
+    QCOMPARE(image.freeSpace(), TEST_FLASH_SIZE - 30);
+}
+
+void TestFlashImage::largestFreeSpace()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+    QCOMPARE(image.largestFreeSpace(), TEST_FLASH_SIZE);
+
+    // A short table in the last page leaves the rest of that page free
+    QVERIFY(image.addSection("table", TEST_FLASH_SIZE - TEST_PAGE_SIZE, fill(10, 't')));
+    QCOMPARE(image.largestFreeSpace(), TEST_FLASH_SIZE - TEST_PAGE_SIZE);
+
+    QVERIFY(image.addSection("sketch", 0, fill(800, 's')));
+    QCOMPARE(image.largestFreeSpace(), TEST_PAGE_SIZE - 10);
+
+    // Which is the largest section that can still be placed
+    QCOMPARE(image.allocateSection("too large", fill(TEST_PAGE_SIZE - 9, 'x'), 1), -1);
+    QCOMPARE(image.allocateSection("pattern", fill(TEST_PAGE_SIZE - 10, 'p'), 1),
+             TEST_FLASH_SIZE - TEST_PAGE_SIZE + 10);
+    QCOMPARE(image.largestFreeSpace(), 96);
+}
+
+void TestFlashImage::toByteArray()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+    QVERIFY(image.toByteArray().isEmpty());
+
+    QVERIFY(image.addSection("a", 0, fill(10, 'a')));
+    QVERIFY(image.addSection("b", 2*TEST_PAGE_SIZE, fill(10, 'b')));
+
+    // Runs to the end of the last page used, with erased flash between sections
+    QByteArray expected = fill(3*TEST_PAGE_SIZE, static_cast<char>(0xFF));
+    expected.replace(0, 10, fill(10, 'a'));
+    expected.replace(2*TEST_PAGE_SIZE, 10, fill(10, 'b'));
+
+    QCOMPARE(image.toByteArray(), expected);
+}
+
+void TestFlashImage::dirtyPages()
+{
+    FlashImage image(TEST_FLASH_SIZE, TEST_PAGE_SIZE);
+
+    // Spans the first two pages
+    QVERIFY(image.addSection("a", 0, fill(TEST_PAGE_SIZE + 10, 'a')));
+
+    // Shares the second page with the first section
+    QCOMPARE(image.allocateSection("b", fill(10, 'b'), 1), TEST_PAGE_SIZE + 10);
+
+    QVERIFY(image.addSection("c", 4*TEST_PAGE_SIZE, fill(10, 'c')));
+
+    QMap<int, QByteArray> pages = image.getDirtyPages();
+    QCOMPARE(pages.keys(), QList<int>() << 0 << TEST_PAGE_SIZE << 4*TEST_PAGE_SIZE);
+
+    QByteArray shared = fill(TEST_PAGE_SIZE, static_cast<char>(0xFF));
+    shared.replace(0, 10, fill(10, 'a'));
+    shared.replace(10, 10, fill(10, 'b'));
+    QCOMPARE(pages.value(TEST_PAGE_SIZE), shared);
+
+    foreach(const QByteArray& page, pages) {
+        QCOMPARE(page.length(), TEST_PAGE_SIZE);
+    }
+}
+
+void TestFlashImage::mergePages()
+{
+    QMap<int, QByteArray> pages;
+    pages.insert(0, fill(TEST_PAGE_SIZE, '0'));
+    pages.insert(TEST_PAGE_SIZE, fill(TEST_PAGE_SIZE, '1'));
+    pages.insert(3*TEST_PAGE_SIZE, fill(TEST_PAGE_SIZE, '3'));
+
+    QList<FlashSection> runs = FlashImage::mergePages(pages);
+    QCOMPARE(runs.length(), 2);
+
+    QCOMPARE(runs.at(0).address, 0);
+    QCOMPARE(runs.at(0).data, fill(TEST_PAGE_SIZE, '0') + fill(TEST_PAGE_SIZE, '1'));
+
+    QCOMPARE(runs.at(1).address, 3*TEST_PAGE_SIZE);
+    QCOMPARE(runs.at(1).data, fill(TEST_PAGE_SIZE, '3'));
+
+    QVERIFY(FlashImage::mergePages(QMap<int, QByteArray>()).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestFlashImage)
+#include "tst_flashimage.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_flashrecord
+
+SOURCES += tst_flashrecord.cpp \
+    $$PATTERNPAINT/flashrecord.cpp \
+    $$PATTERNPAINT/flashimage.cpp
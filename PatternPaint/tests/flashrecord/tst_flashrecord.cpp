@@ -0,0 +1,165 @@
+#include <QtTest>
+#include <QSettings>
+
+#include "flashrecord.h"
+
+// Serial numbers of the pretend devices
+#define TEST_SERIAL       "TEST-DEVICE-1"
+#define OTHER_TEST_SERIAL "TEST-DEVICE-2"
+
+/// Checks that FlashRecord only reports the pages that differ from the last
+/// upload, and that it forgets pages that might not have been written.
+class TestFlashRecord : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void noSerialNumber();
+    void unchangedPagesSkipped();
+    void changedPageFound();
+    void removedPagesWritten();
+    void saveAndLoad();
+    void damagedRecord();
+
+private:
+    /// Build an image with a sketch across the first pages, and a short table
+    /// in the last page of the flash
+    static FlashImage makeImage(char sketchFill);
+};
+
+void TestFlashRecord::initTestCase()
+{
+    // Keep the records away from the settings of a real PatternPaint
+    QCoreApplication::setOrganizationName("PatternPaint Tests");
+    QCoreApplication::setApplicationName("tst_flashrecord");
+}
+
+void TestFlashRecord::init()
+{
+    QSettings settings;
+    settings.remove("FlashRecords");
+}
+
+void TestFlashRecord::cleanupTestCase()
+{
+    QSettings settings;
+    settings.remove("FlashRecords");
+}
+
+FlashImage TestFlashRecord::makeImage(char sketchFill)
+{
+    FlashImage image;
+    image.addSection("sketch", FLASH_MEMORY_SKETCH_ADDRESS,
+                     QByteArray(3*FLASH_MEMORY_PAGE_SIZE + 10, sketchFill));
+    image.addSection("table", FLASH_MEMORY_PATTERN_TABLE_ADDRESS, QByteArray(10, 't'));
+    return image;
+}
+
+void TestFlashRecord::noSerialNumber()
+{
+    FlashImage image = makeImage('s');
+
+    FlashRecord record("");
+    QVERIFY(record.isEmpty());
+
+    record.addPages(image.getDirtyPages());
+    record.save();
+
+    // Without a serial number, nothing is kept between uploads
+    FlashRecord reloaded("");
+    QVERIFY(reloaded.isEmpty());
+    QCOMPARE(reloaded.getChangedPages(image), image.getDirtyPages());
+}
+
+void TestFlashRecord::unchangedPagesSkipped()
+{
+    FlashImage image = makeImage('s');
+
+    FlashRecord record(TEST_SERIAL);
+    QVERIFY(record.isEmpty());
+    QCOMPARE(record.getChangedPages(image), image.getDirtyPages());
+
+    record.addPages(image.getDirtyPages());
+    QVERIFY(!record.isEmpty());
+    QVERIFY(record.getChangedPages(image).isEmpty());
+}
+
+void TestFlashRecord::changedPageFound()
+{
+    FlashRecord record(TEST_SERIAL);
+    record.addPages(makeImage('s').getDirtyPages());
+
+    // Change one byte of the sketch, in its second page
+    FlashImage image = makeImage('s');
+    QByteArray sketch = image.findSection("sketch")->data;
+    sketch[FLASH_MEMORY_PAGE_SIZE + 5] = 'x';
+    QVERIFY(image.updateSection("sketch", sketch));
+
+    QMap<int, QByteArray> changed = record.getChangedPages(image);
+    QCOMPARE(changed.keys(), QList<int>() << FLASH_MEMORY_PAGE_SIZE);
+    QCOMPARE(changed.value(FLASH_MEMORY_PAGE_SIZE),
+             image.getDirtyPages().value(FLASH_MEMORY_PAGE_SIZE));
+
+    // A new table is found in the last page of the flash
+    QVERIFY(image.updateSection("table", QByteArray(10, 'T')));
+    QCOMPARE(record.getChangedPages(image).keys(),
+             QList<int>() << FLASH_MEMORY_PAGE_SIZE << FLASH_MEMORY_PATTERN_TABLE_ADDRESS);
+}
+
+void TestFlashRecord::removedPagesWritten()
+{
+    FlashImage image = makeImage('s');
+
+    FlashRecord record(TEST_SERIAL);
+    record.addPages(image.getDirtyPages());
+
+    // Pages are forgotten before they are written, and stay forgotten if the
+    // upload stops before they are added back
+    QMap<int, QByteArray> writing;
+    writing.insert(0, image.getDirtyPages().value(0));
+    record.removePages(writing);
+    record.save();
+
+    FlashRecord reloaded(TEST_SERIAL);
+    QCOMPARE(reloaded.getChangedPages(image).keys(), QList<int>() << 0);
+
+    reloaded.clear();
+    QVERIFY(reloaded.isEmpty());
+    QCOMPARE(reloaded.getChangedPages(image), image.getDirtyPages());
+}
+
+void TestFlashRecord::saveAndLoad()
+{
+    FlashImage image = makeImage('s');
+
+    FlashRecord record(TEST_SERIAL);
+    record.addPages(image.getDirtyPages());
+    record.save();
+
+    // Includes the table page, whose address needs both bytes of the record
+    FlashRecord reloaded(TEST_SERIAL);
+    QVERIFY(reloaded.getChangedPages(image).isEmpty());
+    QVERIFY(!reloaded.getChangedPages(makeImage('S')).isEmpty());
+
+    // Records are kept per device
+    FlashRecord other(OTHER_TEST_SERIAL);
+    QVERIFY(other.isEmpty());
+}
+
+void TestFlashRecord::damagedRecord()
+{
+    QSettings settings;
+    settings.beginGroup("FlashRecords");
+    settings.setValue(TEST_SERIAL, QByteArray(5, 'x'));
+    settings.endGroup();
+
+    FlashRecord record(TEST_SERIAL);
+    QVERIFY(record.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestFlashRecord)
+#include "tst_flashrecord.moc"
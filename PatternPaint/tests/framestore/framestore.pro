@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_framestore
+
+SOURCES += tst_framestore.cpp \
+    $$PATTERNPAINT/framestore.cpp
@@ -0,0 +1,209 @@
+#include <QtTest>
+
+#include "framestore.h"
+
+Q_DECLARE_METATYPE(QImage::Format)
+
+/// Checks that FrameStore lays out frames the way the encoders expect, and
+/// that partial updates and frame hashes follow changes to the image.
+class TestFrameStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void empty();
+
+    void layout_data();
+    void layout();
+
+    void dataConstructor();
+    void toImage();
+
+    void updateRegion();
+    void updateOnlyCopiesRegion();
+    void updateOutsideImage();
+    void updateResized();
+
+    void hashes();
+};
+
+/// Build an image where every pixel has a different color
+static QImage makeImage(int frameCount, int ledCount, int seed = 0)
+{
+    QImage image(frameCount, ledCount, QImage::Format_RGB32);
+    for(int frame = 0; frame < frameCount; frame++) {
+        for(int led = 0; led < ledCount; led++) {
+            image.setPixel(frame, led, qRgb(frame, led, (frame*10 + led + seed) & 0xFF));
+        }
+    }
+    return image;
+}
+
+void TestFrameStore::empty()
+{
+    FrameStore frames;
+    QCOMPARE(frames.frameCount(), 0);
+    QCOMPARE(frames.ledCount(), 0);
+    QVERIFY(frames.frameData().isEmpty());
+
+    FrameStore fromImage((QImage()));
+    QCOMPARE(fromImage.frameCount(), 0);
+    QVERIFY(fromImage.frameData().isEmpty());
+}
+
+void TestFrameStore::layout_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+
+    QTest::newRow("RGB32") << QImage::Format_RGB32;
+    QTest::newRow("ARGB32") << QImage::Format_ARGB32;
+    QTest::newRow("RGB888") << QImage::Format_RGB888;
+}
+
+void TestFrameStore::layout()
+{
+    QFETCH(QImage::Format, format);
+
+    const int frameCount = 4;
+    const int ledCount = 3;
+    FrameStore frames(makeImage(frameCount, ledCount).convertToFormat(format));
+
+    QCOMPARE(frames.frameCount(), frameCount);
+    QCOMPARE(frames.ledCount(), ledCount);
+    QCOMPARE(frames.frameData().length(), frameCount*ledCount*3);
+
+    // Each frame is a column of the image, stored as one block of RGB24 data
+    const uchar* data = reinterpret_cast<const uchar*>(frames.frameData().constData());
+    for(int frame = 0; frame < frameCount; frame++) {
+        QCOMPARE(frames.frame(frame), data + frame*ledCount*3);
+
+        for(int led = 0; led < ledCount; led++) {
+            const uchar* color = data + (frame*ledCount + led)*3;
+            QCOMPARE(int(color[0]), frame);
+            QCOMPARE(int(color[1]), led);
+            QCOMPARE(int(color[2]), frame*10 + led);
+
+            QCOMPARE(frames.pixel(frame, led), qRgb(frame, led, frame*10 + led));
+        }
+    }
+}
+
+void TestFrameStore::dataConstructor()
+{
+    FrameStore fromImage(makeImage(5, 7));
+    FrameStore fromData(5, 7, fromImage.frameData());
+
+    QCOMPARE(fromData.frameCount(), 5);
+    QCOMPARE(fromData.ledCount(), 7);
+    QCOMPARE(fromData.frameData(), fromImage.frameData());
+
+    for(int frame = 0; frame < 5; frame++) {
+        QCOMPARE(fromData.frameHash(frame), fromImage.frameHash(frame));
+    }
+}
+
+void TestFrameStore::toImage()
+{
+    QImage image = makeImage(6, 5);
+    QImage converted = FrameStore(image).toImage();
+
+    QCOMPARE(converted.width(), 6);
+    QCOMPARE(converted.height(), 5);
+    QCOMPARE(converted.format(), QImage::Format_RGB32);
+    QVERIFY(converted == image);
+}
+
+void TestFrameStore::updateRegion()
+{
+    QImage image = makeImage(8, 6);
+    FrameStore frames(image);
+    FrameStore original = frames;
+
+    // Paint over frames 2 to 4, LEDs 1 to 3
+    QRect region(2, 1, 3, 3);
+    for(int frame = region.left(); frame <= region.right(); frame++) {
+        for(int led = region.top(); led <= region.bottom(); led++) {
+            image.setPixel(frame, led, qRgb(200, 100, 50));
+        }
+    }
+    frames.update(image, region);
+
+    QCOMPARE(frames.frameData(), FrameStore(image).frameData());
+
+    // Only the hashes of the frames in the region change
+    for(int frame = 0; frame < 8; frame++) {
+        if(frame >= region.left() && frame <= region.right()) {
+            QVERIFY(frames.frameHash(frame) != original.frameHash(frame));
+        }
+        else {
+            QCOMPARE(frames.frameHash(frame), original.frameHash(frame));
+        }
+    }
+
+    // The copy that was taken before the update still has the old data
+    QCOMPARE(original.pixel(2, 1), qRgb(2, 1, 21));
+}
+
+void TestFrameStore::updateOnlyCopiesRegion()
+{
+    QImage image = makeImage(4, 4);
+    FrameStore frames(image);
+
+    image.setPixel(0, 0, qRgb(1, 1, 1));
+    image.setPixel(3, 3, qRgb(2, 2, 2));
+    frames.update(image, QRect(3, 3, 1, 1));
+
+    QCOMPARE(frames.pixel(0, 0), qRgb(0, 0, 0));
+    QCOMPARE(frames.pixel(3, 3), qRgb(2, 2, 2));
+}
+
+void TestFrameStore::updateOutsideImage()
+{
+    QImage image = makeImage(4, 4);
+    FrameStore frames(image);
+    QByteArray before = frames.frameData();
+
+    image.fill(qRgb(9, 9, 9));
+
+    // A region that is partly outside the image is clipped to it
+    frames.update(image, QRect(2, 2, 10, 10));
+    QCOMPARE(frames.pixel(3, 3), qRgb(9, 9, 9));
+    QCOMPARE(frames.pixel(1, 1), qRgb(1, 1, 11));
+
+    // And one that is completely outside is ignored
+    FrameStore untouched(makeImage(4, 4));
+    untouched.update(image, QRect(10, 10, 5, 5));
+    QCOMPARE(untouched.frameData(), before);
+}
+
+void TestFrameStore::updateResized()
+{
+    FrameStore frames(makeImage(4, 4));
+
+    // An image of a different size replaces everything, whatever the region
+    QImage larger = makeImage(6, 5, 3);
+    frames.update(larger, QRect(0, 0, 1, 1));
+
+    QCOMPARE(frames.frameCount(), 6);
+    QCOMPARE(frames.ledCount(), 5);
+    QCOMPARE(frames.frameData(), FrameStore(larger).frameData());
+}
+
+void TestFrameStore::hashes()
+{
+    // Frames 0 and 2 are the same, frame 1 differs from them in one byte
+    QImage image(3, 10, QImage::Format_RGB32);
+    image.fill(qRgb(10, 20, 30));
+    image.setPixel(1, 9, qRgb(10, 20, 31));
+
+    FrameStore frames(image);
+    QCOMPARE(frames.frameHash(0), frames.frameHash(2));
+    QVERIFY(frames.frameHash(0) != frames.frameHash(1));
+
+    // Hashes depend only on the frame's data, not on where the frame is
+    FrameStore single(1, 10, QByteArray(reinterpret_cast<const char*>(frames.frame(1)), 10*3));
+    QCOMPARE(single.frameHash(0), frames.frameHash(1));
+}
+
+QTEST_GUILESS_MAIN(TestFrameStore)
+#include "tst_framestore.moc"
@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+TARGET = tst_pattern
+
+SOURCES += tst_pattern.cpp \
+    $$PATTERNPAINT/pattern.cpp \
+    $$PATTERNPAINT/patterndecoder.cpp \
+    $$PATTERNPAINT/framestore.cpp \
+    $$PATTERNPAINT/framecache.cpp \
+    $$PATTERNPAINT/colormodel.cpp \
+    $$PATTERNPAINT/paletteanalysis.cpp \
+    $$PATTERNPAINT/palettequantizer.cpp
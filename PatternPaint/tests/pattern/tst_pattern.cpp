@@ -0,0 +1,257 @@
+#include <QtTest>
+
+#include "pattern.h"
+#include "patterndecoder.h"
+#include "palettequantizer.h"
+#include "colormodel.h"
+#include "framestore.h"
+
+Q_DECLARE_METATYPE(FrameStore)
+
+/// Encodes patterns in every encoding that Pattern offers, and checks that
+/// PatternDecoder gives back what the device would show.
+class TestPattern : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+
+    void longRuns_data();
+    void longRuns();
+
+    void truncatedData_data();
+    void truncatedData();
+
+private:
+    /// Build the test patterns, one row for each pattern and encoding
+    static void addPatternRows();
+
+    /// Work out what the device shows for a pattern, without using the
+    /// encoders or the decoder
+    /// @param frames Frames that the pattern was encoded from
+    /// @param encoding Encoding of the pattern
+    /// @param profile Color profile the pattern was encoded with
+    /// @return Packed RGB24 data for each frame, one after another
+    static QByteArray expectedFrames(const FrameStore& frames, Pattern::Encoding encoding,
+                                     ColorModel::Profile profile);
+};
+
+/// Build a frame store from a function of the frame and LED index
+template <typename ColorFunction>
+static FrameStore makeFrames(int frameCount, int ledCount, ColorFunction color)
+{
+    QByteArray data;
+    for(int frame = 0; frame < frameCount; frame++) {
+        for(int led = 0; led < ledCount; led++) {
+            QRgb value = color(frame, led);
+            data.append(static_cast<char>(qRed(value)));
+            data.append(static_cast<char>(qGreen(value)));
+            data.append(static_cast<char>(qBlue(value)));
+        }
+    }
+
+    return FrameStore(frameCount, ledCount, data);
+}
+
+static QRgb fewColors(int frame, int led)
+{
+    static const QRgb colors[] = {
+        qRgb(255, 0, 0), qRgb(0, 255, 0), qRgb(0, 0, 255), qRgb(255, 255, 255), qRgb(0, 0, 0),
+    };
+    return colors[((frame + led)/7) % 5];
+}
+
+static QRgb gradient(int frame, int led)
+{
+    // More than 256 colors, so the indexed encodings are lossy
+    return qRgb((frame*6) & 0xFF, (led*4) & 0xFF, (frame*led) & 0xFF);
+}
+
+static QRgb longRunColors(int frame, int led)
+{
+    // Runs that don't fit in a 1-byte run count
+    switch(frame) {
+    case 0:
+        return qRgb(10, 20, 30);
+    case 1:
+        return (led < 300) ? qRgb(200, 100, 0) : qRgb(0, 100, 200);
+    default:
+        return ((led/256) % 2) ? qRgb(255, 255, 255) : qRgb(1, 2, 3);
+    }
+}
+
+static QRgb singleLed(int frame, int)
+{
+    return qRgb(frame*50, 255 - frame*50, 7);
+}
+
+void TestPattern::addPatternRows()
+{
+    QTest::addColumn<FrameStore>("frames");
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<int>("profile");
+
+    QList<QPair<QString, FrameStore> > patterns;
+    patterns.append(qMakePair(QString("few colors"), makeFrames(20, 60, fewColors)));
+    patterns.append(qMakePair(QString("gradient"), makeFrames(40, 64, gradient)));
+    patterns.append(qMakePair(QString("long runs"), makeFrames(3, 600, longRunColors)));
+    patterns.append(qMakePair(QString("single LED"), makeFrames(5, 1, singleLed)));
+
+    QList<ColorModel::Profile> profiles;
+    profiles << ColorModel::PROFILE_LINEAR << ColorModel::PROFILE_BLINKYTAPE;
+
+    // Every encoding is covered, including any that are added later
+    for(int index = 0; index < patterns.length(); index++) {
+        foreach(Pattern::Encoding encoding, Pattern::encodings()) {
+            foreach(ColorModel::Profile profile, profiles) {
+                QString name = QString("%1, encoding %2, %3")
+                        .arg(patterns[index].first)
+                        .arg(encoding)
+                        .arg(ColorModel::getProfileName(profile));
+
+                QTest::newRow(name.toLocal8Bit().constData())
+                        << patterns[index].second << int(encoding) << int(profile);
+            }
+        }
+    }
+}
+
+QByteArray TestPattern::expectedFrames(const FrameStore& frames, Pattern::Encoding encoding,
+                                       ColorModel::Profile profile)
+{
+    QByteArray expected;
+
+    switch(encoding) {
+    case Pattern::RGB24:
+    case Pattern::RGB565_RLE:
+        expected = QByteArray(frames.frameCount()*frames.ledCount()*3, 0);
+        ColorModel::correctBrightness(frames.frame(0), frames.frameCount()*frames.ledCount(),
+                                      reinterpret_cast<uchar*>(expected.data()), profile);
+
+        // The low bits of each channel are dropped, and come back as zeros
+        if(encoding == Pattern::RGB565_RLE) {
+            for(int index = 0; index < expected.length(); index += 3) {
+                expected[index    ] = expected.at(index    ) & 0xF8;
+                expected[index + 1] = expected.at(index + 1) & 0xFC;
+                expected[index + 2] = expected.at(index + 2) & 0xF8;
+            }
+        }
+        break;
+
+    case Pattern::INDEXED:
+    case Pattern::INDEXED_RLE:
+        {
+            // Each LED shows the brightness corrected color of its palette entry
+            QuantizedFrames indexed = PaletteQuantizer::quantize(frames);
+            for(int frame = 0; frame < frames.frameCount(); frame++) {
+                for(int led = 0; led < frames.ledCount(); led++) {
+                    QRgb color = ColorModel::correctBrightness(
+                                indexed.palette.at(indexed.frame(frame)[led]), profile);
+                    expected.append(static_cast<char>(qRed(color)));
+                    expected.append(static_cast<char>(qGreen(color)));
+                    expected.append(static_cast<char>(qBlue(color)));
+                }
+            }
+        }
+        break;
+
+    default:
+        qWarning() << "No expected output for encoding" << encoding;
+        break;
+    }
+
+    return expected;
+}
+
+void TestPattern::roundTrip_data()
+{
+    addPatternRows();
+}
+
+void TestPattern::roundTrip()
+{
+    QFETCH(FrameStore, frames);
+    QFETCH(int, encoding);
+    QFETCH(int, profile);
+
+    Pattern pattern(frames, 10, static_cast<Pattern::Encoding>(encoding),
+                    static_cast<ColorModel::Profile>(profile));
+    QVERIFY(pattern.valid);
+    QCOMPARE(pattern.frameCount, frames.frameCount());
+    QCOMPARE(pattern.ledCount, frames.ledCount());
+
+    PatternDecoder decoder(pattern);
+    FrameStore decoded = decoder.decodeAll();
+    QVERIFY2(decoder.isValid(), decoder.getErrorString().toLocal8Bit().constData());
+
+    QCOMPARE(decoded.frameCount(), frames.frameCount());
+    QCOMPARE(decoded.ledCount(), frames.ledCount());
+    QCOMPARE(decoded.frameData(), expectedFrames(frames, pattern.encoding, pattern.profile));
+
+    // The check that the EncodingSelector runs on each candidate
+    PatternDecoder checker(pattern);
+    QVERIFY2(checker.matches(frames), checker.getErrorString().toLocal8Bit().constData());
+}
+
+void TestPattern::longRuns_data()
+{
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<int>("bytesPerRun");
+    QTest::addColumn<int>("headerLength");
+
+    // One color, so the indexed color table has a single entry
+    QTest::newRow("RGB565_RLE") << int(Pattern::RGB565_RLE) << 3 << 0;
+    QTest::newRow("INDEXED_RLE") << int(Pattern::INDEXED_RLE) << 2 << 4;
+}
+
+void TestPattern::longRuns()
+{
+    QFETCH(int, encoding);
+    QFETCH(int, bytesPerRun);
+    QFETCH(int, headerLength);
+
+    // 600 LEDs of one color are stored as runs of 255, 255 and 90
+    FrameStore frames = makeFrames(1, 600, longRunColors);
+
+    Pattern pattern(frames, 10, static_cast<Pattern::Encoding>(encoding),
+                    ColorModel::PROFILE_LINEAR);
+    QVERIFY(pattern.valid);
+    QCOMPARE(pattern.data.length(), headerLength + 3*bytesPerRun);
+
+    const uchar* runs = reinterpret_cast<const uchar*>(pattern.data.constData()) + headerLength;
+    QCOMPARE(int(runs[0]), 255);
+    QCOMPARE(int(runs[bytesPerRun]), 255);
+    QCOMPARE(int(runs[2*bytesPerRun]), 90);
+
+    QVERIFY(PatternDecoder(pattern).matches(frames));
+}
+
+void TestPattern::truncatedData_data()
+{
+    addPatternRows();
+}
+
+void TestPattern::truncatedData()
+{
+    QFETCH(FrameStore, frames);
+    QFETCH(int, encoding);
+    QFETCH(int, profile);
+
+    Pattern pattern(frames, 10, static_cast<Pattern::Encoding>(encoding),
+                    static_cast<ColorModel::Profile>(profile));
+    QVERIFY(pattern.valid);
+
+    // A pattern that is cut short has to be reported, not read past its end
+    Pattern truncated(pattern.data.left(pattern.data.length() - 1), pattern.encoding,
+                      pattern.frameCount, pattern.ledCount, pattern.frameDelay, pattern.profile);
+
+    PatternDecoder decoder(truncated);
+    QVERIFY(decoder.decodeAll().frameCount() == 0);
+    QVERIFY(!decoder.isValid());
+    QVERIFY(!PatternDecoder(truncated).matches(frames));
+}
+
+QTEST_GUILESS_MAIN(TestPattern)
+#include "tst_pattern.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_serialcommandqueue
+
+SOURCES += tst_serialcommandqueue.cpp \
+    $$PATTERNPAINT/serialcommandqueue.cpp \
+    $$PATTERNPAINT/serialcommand.cpp
@@ -0,0 +1,330 @@
+#include <QtTest>
+#include <QElapsedTimer>
+
+#include "serialcommandqueue.h"
+
+#if defined(Q_OS_UNIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+/// How long to wait for data that should arrive, in ms
+#define TEST_WAIT_TIME 2000
+
+/// How long to wait to make sure that no more data arrives, in ms
+#define TEST_QUIET_TIME 200
+
+/// A pretend device on the other end of a pseudo-terminal. The queue opens the
+/// slave side by name, like a real serial port, and the test reads the
+/// commands and writes the responses on the master side.
+class PseudoTerminal
+{
+public:
+    PseudoTerminal();
+    ~PseudoTerminal();
+
+    /// True if the pseudo-terminal could be made
+    bool isOpen() const;
+
+    /// Name of the slave side, for SerialCommandQueue::open()
+    QString slaveName() const;
+
+    /// Read what the queue has sent, running the event loop while waiting
+    /// @param length Number of bytes to wait for
+    /// @param timeout How long to wait for them, in ms
+    /// @return The data that arrived, which is shorter than length on a timeout
+    QByteArray read(int length, int timeout = TEST_WAIT_TIME);
+
+    /// Send a response to the queue
+    void write(const QByteArray& data);
+
+private:
+    int master;     ///< File descriptor of the master side, or -1
+};
+
+PseudoTerminal::PseudoTerminal() :
+    master(-1)
+{
+#if defined(Q_OS_UNIX)
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0) {
+        return;
+    }
+
+    if(grantpt(master) != 0 || unlockpt(master) != 0) {
+        ::close(master);
+        master = -1;
+        return;
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+PseudoTerminal::~PseudoTerminal()
+{
+#if defined(Q_OS_UNIX)
+    if(master >= 0) {
+        ::close(master);
+    }
+#endif
+}
+
+bool PseudoTerminal::isOpen() const
+{
+    return master >= 0;
+}
+
+QString PseudoTerminal::slaveName() const
+{
+#if defined(Q_OS_UNIX)
+    return QString(ptsname(master));
+#else
+    return QString();
+#endif
+}
+
+QByteArray PseudoTerminal::read(int length, int timeout)
+{
+    QByteArray data;
+
+#if defined(Q_OS_UNIX)
+    QElapsedTimer timer;
+    timer.start();
+
+    while(data.length() < length && timer.elapsed() < timeout) {
+        // QSerialPort writes from the event loop
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+
+        char buffer[256];
+        ssize_t count = ::read(master, buffer, qMin(int(sizeof(buffer)), length - data.length()));
+        if(count > 0) {
+            data.append(buffer, count);
+        }
+        else if(count < 0 && errno != EAGAIN && errno != EINTR) {
+            break;
+        }
+    }
+#else
+    Q_UNUSED(length);
+    Q_UNUSED(timeout);
+#endif
+
+    return data;
+}
+
+void PseudoTerminal::write(const QByteArray& data)
+{
+#if defined(Q_OS_UNIX)
+    ssize_t written = ::write(master, data.constData(), data.length());
+    Q_UNUSED(written);
+#else
+    Q_UNUSED(data);
+#endif
+}
+
+/// Checks that SerialCommandQueue keeps the requested number of commands in
+/// flight, matches the responses to them in order, and gives up on the link
+/// when the device sends something wrong or stops answering.
+class TestSerialCommandQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void windowLimitsCommandsInFlight_data();
+    void windowLimitsCommandsInFlight();
+
+    void responsesSplitAcrossReads();
+    void garbageResponse();
+    void unexpectedData();
+    void timeout();
+
+private:
+    PseudoTerminal* device;
+    SerialCommandQueue* queue;
+
+    /// Queue a command that is answered with a carriage return
+    /// @param type Type tag of the command, and the byte sent for it
+    void queueAcknowledgedCommand(int type);
+};
+
+void TestSerialCommandQueue::init()
+{
+    device = 0;
+    queue = 0;
+
+#if !defined(Q_OS_UNIX)
+    QSKIP("Needs a pseudo-terminal to stand in for the device");
+#endif
+
+    device = new PseudoTerminal();
+    QVERIFY(device->isOpen());
+
+    queue = new SerialCommandQueue();
+    QVERIFY(queue->open(device->slaveName()));
+}
+
+void TestSerialCommandQueue::cleanup()
+{
+    delete queue;
+    queue = 0;
+
+    delete device;
+    device = 0;
+}
+
+void TestSerialCommandQueue::queueAcknowledgedCommand(int type)
+{
+    queue->queueCommand(SerialCommand(type, QString("Command %1").arg(type),
+                                      QByteArray(1, static_cast<char>(type)),
+                                      new ExactResponseParser("\r")));
+}
+
+void TestSerialCommandQueue::windowLimitsCommandsInFlight_data()
+{
+    QTest::addColumn<int>("windowSize");
+
+    QTest::newRow("one at a time") << 1;
+    QTest::newRow("pipelined") << 3;
+    QTest::newRow("larger than the queue") << 10;
+}
+
+void TestSerialCommandQueue::windowLimitsCommandsInFlight()
+{
+    QFETCH(int, windowSize);
+
+    const int commandCount = 6;
+    const int firstBatch = qMin(windowSize, commandCount);
+
+    QSignalSpy finished(queue, SIGNAL(commandFinished(int,QByteArray)));
+    QSignalSpy errors(queue, SIGNAL(error(QString)));
+
+    queue->setWindowSize(windowSize);
+    for(int type = 'A'; type < 'A' + commandCount; type++) {
+        queueAcknowledgedCommand(type);
+    }
+
+    // Only a window's worth of commands goes out before any are answered
+    QCOMPARE(device->read(firstBatch), QByteArray("ABCDEF").left(firstBatch));
+    QVERIFY(device->read(1, TEST_QUIET_TIME).isEmpty());
+    QCOMPARE(queue->getCommandsInFlight(), firstBatch);
+
+    // Each response lets one more command out, so the window stays full
+    int sent = firstBatch;
+    for(int answered = 1; answered <= commandCount; answered++) {
+        device->write("\r");
+
+        if(sent < commandCount) {
+            QCOMPARE(device->read(1), QByteArray(1, static_cast<char>('A' + sent)));
+            sent++;
+        }
+        QVERIFY(device->read(1, TEST_QUIET_TIME).isEmpty());
+
+        QTRY_COMPARE(finished.count(), answered);
+        QCOMPARE(queue->getCommandsInFlight(), sent - answered);
+    }
+
+    // The commands finish in the order they were sent
+    for(int index = 0; index < commandCount; index++) {
+        QCOMPARE(finished.at(index).at(0).toInt(), 'A' + index);
+        QCOMPARE(finished.at(index).at(1).toByteArray(), QByteArray("\r"));
+    }
+
+    QCOMPARE(queue->getCommandsInFlight(), 0);
+    QCOMPARE(errors.count(), 0);
+    QVERIFY(queue->isConnected());
+}
+
+void TestSerialCommandQueue::responsesSplitAcrossReads()
+{
+    QSignalSpy finished(queue, SIGNAL(commandFinished(int,QByteArray)));
+
+    queue->setWindowSize(2);
+    queue->queueCommand(SerialCommand(1, "Read 1", "r", new FixedLengthResponseParser(4)));
+    queue->queueCommand(SerialCommand(2, "Read 2", "r", new FixedLengthResponseParser(4)));
+    QCOMPARE(device->read(2), QByteArray("rr"));
+
+    // The first read carries all of the first response and part of the second
+    device->write("abcdef");
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(device->read(1, TEST_QUIET_TIME).isEmpty());
+
+    device->write("gh");
+    QTRY_COMPARE(finished.count(), 2);
+
+    QCOMPARE(finished.at(0).at(0).toInt(), 1);
+    QCOMPARE(finished.at(0).at(1).toByteArray(), QByteArray("abcd"));
+    QCOMPARE(finished.at(1).at(0).toInt(), 2);
+    QCOMPARE(finished.at(1).at(1).toByteArray(), QByteArray("efgh"));
+}
+
+void TestSerialCommandQueue::garbageResponse()
+{
+    QSignalSpy finished(queue, SIGNAL(commandFinished(int,QByteArray)));
+    QSignalSpy errors(queue, SIGNAL(error(QString)));
+
+    queue->setWindowSize(3);
+    for(int type = 'A'; type < 'A' + 5; type++) {
+        queueAcknowledgedCommand(type);
+    }
+    QCOMPARE(device->read(3), QByteArray("ABC"));
+
+    // The first command is answered, and the second gets the wrong response
+    device->write("\r?\r");
+    QTRY_COMPARE(errors.count(), 1);
+    QCOMPARE(finished.count(), 1);
+
+    // The queue gives up on everything, rather than matching the responses
+    // that follow to the wrong commands
+    QVERIFY(!queue->isConnected());
+    QCOMPARE(queue->getCommandsInFlight(), 0);
+
+    QTest::qWait(TEST_QUIET_TIME);
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(errors.count(), 1);
+}
+
+void TestSerialCommandQueue::unexpectedData()
+{
+    QSignalSpy finished(queue, SIGNAL(commandFinished(int,QByteArray)));
+    QSignalSpy errors(queue, SIGNAL(error(QString)));
+
+    // Data with no command waiting for it is dropped, and isn't taken as the
+    // response to the next command
+    device->write("noise");
+    QTest::qWait(TEST_QUIET_TIME);
+    QVERIFY(queue->isConnected());
+
+    queueAcknowledgedCommand('A');
+    QCOMPARE(device->read(1), QByteArray("A"));
+    device->write("\r");
+
+    QTRY_COMPARE(finished.count(), 1);
+    QCOMPARE(errors.count(), 0);
+}
+
+void TestSerialCommandQueue::timeout()
+{
+    QSignalSpy errors(queue, SIGNAL(error(QString)));
+
+    queue->setWindowSize(2);
+    queueAcknowledgedCommand('A');
+    queueAcknowledgedCommand('B');
+    QCOMPARE(device->read(2), QByteArray("AB"));
+
+    // Only the first command is answered, and the device then goes quiet
+    device->write("\r");
+
+    QVERIFY(errors.wait(TEST_WAIT_TIME));
+    QCOMPARE(errors.count(), 1);
+    QVERIFY(!queue->isConnected());
+    QCOMPARE(queue->getCommandsInFlight(), 0);
+}
+
+QTEST_GUILESS_MAIN(TestSerialCommandQueue)
+#include "tst_serialcommandqueue.moc"
@@ -0,0 +1,21 @@
+# Settings shared by the unit tests. Each test builds the PatternPaint sources
+# that it needs, so that it doesn't depend on the GUI.
+
+QT       += core gui testlib
+
+greaterThan(QT_MAJOR_VERSION, 4) {
+    QT       += serialport concurrent
+} else {
+    include($$QTSERIALPORT_PROJECT_ROOT/src/serialport/qt4support/serialport.prf)
+}
+
+TEMPLATE = app
+CONFIG   += testcase console
+CONFIG   -= app_bundle
+
+OBJECTS_DIR = tmp
+MOC_DIR = $$OBJECTS_DIR/moc
+
+PATTERNPAINT = $$PWD/..
+INCLUDEPATH += $$PATTERNPAINT
+DEPENDPATH += $$PATTERNPAINT
@@ -0,0 +1,10 @@
+# Unit tests for PatternPaint. Build and run them with:
+#   qmake && make check
+
+TEMPLATE = subdirs
+
+SUBDIRS += pattern \
+    flashimage \
+    flashrecord \
+    serialcommandqueue \
+    framestore